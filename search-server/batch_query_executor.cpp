@@ -0,0 +1,221 @@
+#include "batch_query_executor.h"
+
+//=================================================================================
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+//=================================================================================
+double BatchStats::GetQueriesPerSecond() const
+{
+    return duration.count() == 0 ? 0. : query_count / std::chrono::duration<double>(duration).count();
+}
+
+//=================================================================================
+BatchQueryExecutor::BatchQueryExecutor(size_t thread_count) : pool_(thread_count)
+{
+    contexts_.reserve(pool_.GetThreadCount());
+    for (size_t i = 0; i < pool_.GetThreadCount(); ++i){
+        contexts_.push_back(std::make_unique<SearchContext>());
+    }
+}
+
+//=================================================================================
+std::vector<std::vector<Document>> BatchQueryExecutor::ProcessQueries(const SearchServer &search_server, const std::vector<std::string> &queries,
+                                                                      DocumentStatus status, const SearchOptions &options)
+{
+    std::vector<std::vector<Document>> results(queries.size());
+    ProcessQueries(search_server, queries, [&results](size_t query_index, std::vector<Document>&& documents){
+        results[query_index] = std::move(documents);
+    }, status, options);
+    return results;
+}
+
+//=================================================================================
+void BatchQueryExecutor::ProcessQueries(const SearchServer &search_server, const std::vector<std::string> &queries, const ResultConsumer &consumer,
+                                        DocumentStatus status, const SearchOptions &options)
+{
+    METRIC_DURATION("process_queries");
+    const auto start_time = std::chrono::steady_clock::now();
+
+    // Parsing, with the number of postings of the plus words as the estimate of the work of a query
+    std::vector<SearchServer::Query> parsed_queries(queries.size());
+    std::vector<size_t> posting_counts(queries.size());
+    pool_.Run(queries.size(), [&](size_t query_index, [[maybe_unused]] size_t worker_index){
+        SearchServer::Query& query = parsed_queries[query_index];
+        query = search_server.ParseQuery(queries[query_index]);
+        search_server.SortQuery(query);
+        for (const std::string_view word : query.plus_words){
+            posting_counts[query_index] += search_server.GetTermDocumentCount(word);
+        }
+    });
+
+    const std::vector<QueryTask> tasks = MakeTasks(search_server, posting_counts, options);
+    // A query is complete once the last of its tasks is done
+    std::vector<std::vector<size_t>> query_range_tasks(queries.size());
+    for (size_t i = 0; i < tasks.size(); ++i){
+        if (!tasks[i].is_whole_query){
+            query_range_tasks[tasks[i].query_index].push_back(i);
+        }
+    }
+    const std::unique_ptr<std::atomic<size_t>[]> remaining_task_counts(new std::atomic<size_t>[queries.size()]);
+    size_t split_query_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i){
+        remaining_task_counts[i] = std::max<size_t>(query_range_tasks[i].size(), 1);
+        split_query_count += !query_range_tasks[i].empty();
+    }
+
+    // Results are handed over in the order of the queries by the calling thread
+    std::vector<std::vector<Document>> results(queries.size());
+    std::vector<char> is_ready(queries.size(), false);
+    bool is_failed = false;
+    std::mutex delivery_mutex;
+    std::condition_variable delivery_ready;
+    const auto complete_query = [&](size_t query_index){
+        {
+            std::lock_guard delivery_guard(delivery_mutex);
+            is_ready[query_index] = true;
+        }
+        delivery_ready.notify_one();
+    };
+
+    const SearchFilter filter(status);
+    std::vector<std::vector<Document>> range_results(tasks.size());
+    const auto score_task = [&](size_t task_index, size_t worker_index){
+        const QueryTask& task = tasks[task_index];
+        const SearchServer::Query& query = parsed_queries[task.query_index];
+        SearchContext& context = *contexts_[worker_index];
+        if (task.is_whole_query){
+            search_server.SelectCachedTopDocuments(query, status, options, results[task.query_index], [&](std::vector<Document>& documents){
+                search_server.SelectTopDocuments(query, filter, options, context);
+                documents = context.documents_;
+            });
+            complete_query(task.query_index);
+            return;
+        }
+
+        search_server.SelectTopDocumentsInRange(query, filter, options, context, task.ordinal_begin, task.ordinal_end);
+        range_results[task_index] = context.documents_;
+        if (remaining_task_counts[task.query_index].fetch_sub(1) == 1){
+            // The ranges hold disjoint documents, the result is the best of their results
+            TopDocuments& top_documents = context.top_documents_;
+            top_documents.Reset(options.max_result_document_count);
+            for (const size_t range_task_index : query_range_tasks[task.query_index]){
+                for (const Document& document : range_results[range_task_index]){
+                    top_documents.Add(document);
+                }
+            }
+            top_documents.ExtractTo(results[task.query_index]);
+            complete_query(task.query_index);
+        }
+    };
+
+    WorkStealingThreadPool::Batch batch([&](size_t task_index, size_t worker_index){
+        try {
+            score_task(task_index, worker_index);
+        } catch (...) {
+            // The queries after a failed one are never delivered, Wait rethrows the exception
+            {
+                std::lock_guard delivery_guard(delivery_mutex);
+                is_failed = true;
+            }
+            delivery_ready.notify_one();
+            throw;
+        }
+    });
+    pool_.Start(batch, tasks.size());
+    try {
+        std::unique_lock delivery_lock(delivery_mutex);
+        for (size_t query_index = 0; query_index < queries.size(); ++query_index){
+            delivery_ready.wait(delivery_lock, [&]{ return is_ready[query_index] || is_failed; });
+            if (!is_ready[query_index]){
+                break;
+            }
+            std::vector<Document> documents = std::move(results[query_index]);
+            delivery_lock.unlock();
+            consumer(query_index, std::move(documents));
+            delivery_lock.lock();
+        }
+    } catch (...) {
+        // The tasks use the locals of this call, they have to finish before it returns
+        try {
+            pool_.Wait(batch);
+        } catch (...) {
+        }
+        throw;
+    }
+    pool_.Wait(batch);
+
+    BatchStats stats;
+    stats.query_count = queries.size();
+    stats.task_count = tasks.size();
+    stats.split_query_count = split_query_count;
+    stats.duration = std::chrono::steady_clock::now() - start_time;
+    {
+        std::lock_guard guard(stats_mutex_);
+        last_stats_ = stats;
+    }
+
+    static MetricCounter& query_counter = MetricsRegistry::GetDefault().GetCounter("process_queries.queries");
+    static MetricCounter& split_query_counter = MetricsRegistry::GetDefault().GetCounter("process_queries.split_queries");
+    query_counter.Add(queries.size());
+    split_query_counter.Add(split_query_count);
+}
+
+//=================================================================================
+std::vector<BatchQueryExecutor::QueryTask> BatchQueryExecutor::MakeTasks(const SearchServer &search_server, const std::vector<size_t> &posting_counts,
+                                                                         const SearchOptions &options) const
+{
+    // Ranges are scored with MaxScore, so queries are split only when it is on
+    const size_t thread_count = pool_.GetThreadCount();
+    const bool may_split = thread_count > 1 && options.use_dynamic_pruning;
+    const size_t total_posting_count = std::accumulate(posting_counts.begin(), posting_counts.end(), size_t{0});
+    const size_t task_posting_count = std::max(MIN_SPLIT_POSTING_COUNT, total_posting_count / (thread_count * TASKS_PER_THREAD));
+    const int ordinal_count = static_cast<int>(search_server.ordinal_to_document_id_.size());
+
+    std::vector<QueryTask> tasks;
+    tasks.reserve(posting_counts.size());
+    for (size_t query_index = 0; query_index < posting_counts.size(); ++query_index){
+        const size_t posting_count = posting_counts[query_index];
+        const size_t range_count = may_split
+                ? std::min(thread_count, (posting_count + task_posting_count - 1) / task_posting_count)
+                : 1;
+        if (range_count <= 1){
+            tasks.push_back({query_index, 0, ordinal_count, posting_count, true});
+            continue;
+        }
+        for (size_t range = 0; range < range_count; ++range){
+            tasks.push_back({query_index,
+                             static_cast<int>(ordinal_count * range / range_count),
+                             static_cast<int>(ordinal_count * (range + 1) / range_count),
+                             posting_count / range_count,
+                             false});
+        }
+    }
+
+    // Workers take their own tasks from the last ones: the heaviest tasks start first, the light ones are stolen
+    std::stable_sort(tasks.begin(), tasks.end(), [](const QueryTask& lhs, const QueryTask& rhs){
+        return lhs.posting_count < rhs.posting_count;
+    });
+    return tasks;
+}
+
+//=================================================================================
+BatchStats BatchQueryExecutor::GetLastBatchStats() const
+{
+    std::lock_guard guard(stats_mutex_);
+    return last_stats_;
+}
+
+//=================================================================================
+size_t BatchQueryExecutor::GetThreadCount() const
+{
+    return pool_.GetThreadCount();
+}
+
+//=================================================================================
+BatchQueryExecutor &BatchQueryExecutor::GetDefault()
+{
+    static BatchQueryExecutor executor;
+    return executor;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+//=================================================================================
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//=================================================================================
+#include "search_server.h"
+#include "thread_pool.h"
+
+//=================================================================================
+struct BatchStats {
+    size_t query_count = 0;
+    size_t task_count = 0;              // scoring tasks: one per query plus the extra ranges of split queries
+    size_t split_query_count = 0;
+    std::chrono::nanoseconds duration{0};
+
+    double GetQueriesPerSecond() const;
+};
+
+//=================================================================================
+// Runs batches of queries on a persistent work-stealing thread pool, every worker with a SearchContext of its own.
+// The queries are parsed in parallel first. A query with more postings than its share of the batch is split into
+// ranges of document ordinals scored as separate tasks, and the top documents of its ranges are merged, so a few
+// long queries do not leave the other threads idle. Results are the same as FindTopDocuments would return.
+// Batches of concurrent callers share the workers
+class BatchQueryExecutor {
+public:
+    using ResultConsumer = std::function<void(size_t query_index, std::vector<Document>&& documents)>;
+
+    explicit BatchQueryExecutor(size_t thread_count = std::thread::hardware_concurrency());
+
+    std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries,
+                                                      DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {});
+    // Passes the result of every query to consumer in the order of the queries, as soon as it and the results
+    // of the queries before it are ready. The consumer is called from the calling thread while the workers go on
+    // with the rest of the batch, so a slow one holds up no worker, and it may run batches of its own
+    void ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries, const ResultConsumer& consumer,
+                        DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {});
+
+    // Statistics of the batch that finished last
+    BatchStats GetLastBatchStats() const;
+    size_t GetThreadCount() const;
+
+    // Executor of the free ProcessQueries functions, created on first use
+    static BatchQueryExecutor& GetDefault();
+
+private:
+    // The batch is cut into about this many tasks per thread when long queries are split
+    inline static constexpr size_t TASKS_PER_THREAD = 4;
+    // Queries with fewer postings are never split: scoring them costs less than setting up the ranges
+    inline static constexpr size_t MIN_SPLIT_POSTING_COUNT = 64 * 1024;
+
+    struct QueryTask {
+        size_t query_index;
+        int ordinal_begin;
+        int ordinal_end;
+        size_t posting_count;       // estimated work
+        bool is_whole_query;
+    };
+
+    WorkStealingThreadPool pool_;
+    std::vector<std::unique_ptr<SearchContext>> contexts_;     // worker -> scratch
+
+    mutable std::mutex stats_mutex_;
+    BatchStats last_stats_;
+
+    std::vector<QueryTask> MakeTasks(const SearchServer& search_server, const std::vector<size_t>& posting_counts, const SearchOptions& options) const;
+};
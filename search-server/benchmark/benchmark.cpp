@@ -0,0 +1,454 @@
+// Benchmark of the search server operations over a generated corpus.
+// Built from the search-server directory, with every source except main.cpp:
+//   g++ -std=c++17 -O2 -I. benchmark/benchmark.cpp $(ls *.cpp | grep -v main.cpp) -ltbb -lpthread -o search_server_benchmark
+// The corpus and the queries depend on the options and the seed only, so the JSON results of two commits
+// run with the same options can be compared case by case
+
+#include "search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "document_generator.h"
+#include "term_idf_table.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+struct BenchmarkConfig {
+    int document_count = 10'000;
+    int vocabulary_size = 1'000;
+    int max_word_length = 10;
+    int document_word_count = 70;
+    int query_count = 100;
+    int query_word_count = 70;
+    double minus_prob = 0.1;
+    double removed_share = 0.1;             // documents removed by the RemoveDocument cases
+    double duplicate_share = 0.1;           // copies of documents added for RemoveDuplicates
+    int matched_documents_per_query = 10;
+    int warmup = 1;
+    int repetitions = 5;
+    unsigned seed = mt19937::default_seed;
+    string filter;                          // runs only the cases with names containing it
+    string json_path;                       // "-" writes the JSON results to the standard output
+};
+
+struct Corpus {
+    vector<string> dictionary;
+    vector<string> documents;
+    vector<string> queries;
+    vector<int> removed_ids;
+    vector<string> duplicates;              // copies of documents, with ids after the originals
+};
+
+struct BenchmarkCase {
+    string name;
+    // Prepares the state of one repetition, not timed
+    function<void()> setup;
+    // Timed, returns the number of operations done
+    function<size_t()> run;
+};
+
+struct BenchmarkResult {
+    string name;
+    size_t operation_count = 0;
+    vector<double> samples_ns;
+    double min_ns = 0;
+    double median_ns = 0;
+    double mean_ns = 0;
+    double stddev_ns = 0;
+    double max_ns = 0;
+};
+
+// Results are accumulated here so that the compiler does not drop the benchmarked calls
+volatile double benchmark_sink = 0;
+
+void PrintUsage(ostream& output) {
+    output << "Usage: search_server_benchmark [--option=value]...\n"
+              "  --documents --vocabulary --word-length --document-words --queries --query-words\n"
+              "  --minus-prob --removed-share --duplicate-share --matched-per-query\n"
+              "  --warmup --repetitions --seed --filter=<name part> --json=<path or ->\n";
+}
+
+BenchmarkConfig ParseArguments(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string_view argument = argv[i];
+        const size_t equal_pos = argument.find('=');
+        if (argument.substr(0, 2) != "--"sv || equal_pos == string_view::npos) {
+            throw invalid_argument("expected --option=value: "s + string(argument));
+        }
+        const string_view name = argument.substr(2, equal_pos - 2);
+        const string value(argument.substr(equal_pos + 1));
+        if (name == "documents"sv) config.document_count = stoi(value);
+        else if (name == "vocabulary"sv) config.vocabulary_size = stoi(value);
+        else if (name == "word-length"sv) config.max_word_length = stoi(value);
+        else if (name == "document-words"sv) config.document_word_count = stoi(value);
+        else if (name == "queries"sv) config.query_count = stoi(value);
+        else if (name == "query-words"sv) config.query_word_count = stoi(value);
+        else if (name == "minus-prob"sv) config.minus_prob = stod(value);
+        else if (name == "removed-share"sv) config.removed_share = stod(value);
+        else if (name == "duplicate-share"sv) config.duplicate_share = stod(value);
+        else if (name == "matched-per-query"sv) config.matched_documents_per_query = stoi(value);
+        else if (name == "warmup"sv) config.warmup = stoi(value);
+        else if (name == "repetitions"sv) config.repetitions = stoi(value);
+        else if (name == "seed"sv) config.seed = static_cast<unsigned>(stoul(value));
+        else if (name == "filter"sv) config.filter = value;
+        else if (name == "json"sv) config.json_path = value;
+        else throw invalid_argument("unknown option: "s + string(name));
+    }
+    if (config.document_count <= 0 || config.vocabulary_size <= 0 || config.max_word_length <= 0 || config.document_word_count <= 0
+            || config.query_count <= 0 || config.query_word_count <= 0 || config.repetitions <= 0 || config.warmup < 0) {
+        throw invalid_argument("sizes and repetitions must be positive");
+    }
+    return config;
+}
+
+Corpus GenerateCorpus(const BenchmarkConfig& config) {
+    mt19937 generator(config.seed);
+    Corpus corpus;
+    corpus.dictionary = GenerateDictionary(generator, config.vocabulary_size, config.max_word_length);
+    corpus.documents = GenerateQueries(generator, corpus.dictionary, config.document_count, config.document_word_count);
+    corpus.queries = GenerateQueries(generator, corpus.dictionary, config.query_count, config.query_word_count, config.minus_prob);
+
+    const int removed_count = static_cast<int>(config.document_count * config.removed_share);
+    corpus.removed_ids.resize(config.document_count);
+    iota(corpus.removed_ids.begin(), corpus.removed_ids.end(), 0);
+    shuffle(corpus.removed_ids.begin(), corpus.removed_ids.end(), generator);
+    corpus.removed_ids.resize(removed_count);
+
+    const int duplicate_count = static_cast<int>(config.document_count * config.duplicate_share);
+    for (int i = 0; i < duplicate_count; ++i) {
+        corpus.duplicates.push_back(corpus.documents[uniform_int_distribution<int>(0, config.document_count - 1)(generator)]);
+    }
+    return corpus;
+}
+
+unique_ptr<SearchServer> BuildServer(const Corpus& corpus, bool with_duplicates) {
+    auto search_server = make_unique<SearchServer>(corpus.dictionary[0]);
+    vector<RawDocument> documents;
+    for (const string& text : corpus.documents) {
+        documents.push_back({static_cast<int>(documents.size()), text, DocumentStatus::ACTUAL, {1, 2, 3}});
+    }
+    if (with_duplicates) {
+        for (const string& text : corpus.duplicates) {
+            documents.push_back({static_cast<int>(documents.size()), text, DocumentStatus::ACTUAL, {1, 2, 3}});
+        }
+    }
+    search_server->AddDocuments(documents);
+    return search_server;
+}
+
+double SumRelevance(const vector<Document>& documents) {
+    double total_relevance = 0;
+    for (const Document& document : documents) {
+        total_relevance += document.relevance;
+    }
+    return total_relevance;
+}
+
+// Document counts of the terms and the term ids of the plus words of the queries, for the IDF cases
+struct IdfLookups {
+    size_t document_count = 0;
+    vector<size_t> term_document_counts;    // term id -> documents containing the term
+    TermIdfTable idf_table;
+    vector<int> query_term_ids;             // plus words of all queries that are in the corpus
+};
+
+// IDF cases repeat the lookups of all queries this many times, so that a sample is not a few microseconds
+constexpr int IDF_PASS_COUNT = 100;
+
+IdfLookups MakeIdfLookups(const Corpus& corpus) {
+    IdfLookups lookups;
+    lookups.document_count = corpus.documents.size();
+    unordered_map<string_view, int> word_to_term_id;
+    vector<int> document_term_ids;
+    for (const string& document : corpus.documents) {
+        document_term_ids.clear();
+        for (const string_view word : SplitIntoWords(document)) {
+            const auto [iter, is_new] = word_to_term_id.emplace(word, static_cast<int>(word_to_term_id.size()));
+            document_term_ids.push_back(iter->second);
+        }
+        sort(document_term_ids.begin(), document_term_ids.end());
+        document_term_ids.erase(unique(document_term_ids.begin(), document_term_ids.end()), document_term_ids.end());
+        lookups.term_document_counts.resize(word_to_term_id.size());
+        for (const int term_id : document_term_ids) {
+            ++lookups.term_document_counts[term_id];
+        }
+    }
+    lookups.idf_table.Resize(lookups.term_document_counts.size());
+    lookups.idf_table.SetDocumentCount(lookups.document_count);
+    for (size_t term_id = 0; term_id < lookups.term_document_counts.size(); ++term_id) {
+        lookups.idf_table.SetTermDocumentCount(static_cast<int>(term_id), lookups.term_document_counts[term_id]);
+    }
+    for (const string& query : corpus.queries) {
+        for (const string_view word : SplitIntoWords(query)) {
+            const auto iter = word_to_term_id.find(word);
+            if (word[0] != '-' && iter != word_to_term_id.end()) {
+                lookups.query_term_ids.push_back(iter->second);
+            }
+        }
+    }
+    return lookups;
+}
+
+template <typename ExecutionPolicy>
+size_t MatchDocuments(const SearchServer& search_server, const BenchmarkConfig& config, const Corpus& corpus, ExecutionPolicy policy) {
+    size_t matched_word_count = 0;
+    size_t operation_count = 0;
+    for (size_t i = 0; i < corpus.queries.size(); ++i) {
+        for (int j = 0; j < config.matched_documents_per_query; ++j) {
+            const int document_id = static_cast<int>((i * config.matched_documents_per_query + j) * 7919 % corpus.documents.size());
+            const auto [words, status] = search_server.MatchDocument(policy, corpus.queries[i], document_id);
+            matched_word_count += words.size();
+            ++operation_count;
+        }
+    }
+    benchmark_sink = benchmark_sink + matched_word_count;
+    return operation_count;
+}
+
+vector<BenchmarkCase> MakeCases(const BenchmarkConfig& config, const Corpus& corpus, unique_ptr<SearchServer>& search_server) {
+    // Cases that do not change the server share the one built before them
+    const auto build = [&corpus, &search_server] { search_server = BuildServer(corpus, false); };
+    const auto build_once = [&corpus, &search_server] {
+        if (!search_server || search_server->GetDocumentCount() != static_cast<int>(corpus.documents.size())) {
+            search_server = BuildServer(corpus, false);
+        }
+    };
+
+    vector<BenchmarkCase> cases;
+    cases.push_back({"add_document",
+        [&corpus, &search_server] { search_server = make_unique<SearchServer>(corpus.dictionary[0]); },
+        [&corpus, &search_server] {
+            for (size_t i = 0; i < corpus.documents.size(); ++i) {
+                search_server->AddDocument(static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }
+            return corpus.documents.size();
+        }});
+    cases.push_back({"remove_document.seq", build, [&corpus, &search_server] {
+        auto policy = execution::seq;
+        for (const int document_id : corpus.removed_ids) {
+            search_server->RemoveDocument(policy, document_id);
+        }
+        return corpus.removed_ids.size();
+    }});
+    cases.push_back({"remove_document.par", build, [&corpus, &search_server] {
+        auto policy = execution::par;
+        for (const int document_id : corpus.removed_ids) {
+            search_server->RemoveDocument(policy, document_id);
+        }
+        return corpus.removed_ids.size();
+    }});
+    // Startup from a snapshot against add_document: LoadSnapshot checks and copies the columns
+    // and rebuilds the hash maps, but tokenizes nothing
+    const string snapshot_path = (filesystem::temp_directory_path() / "search_server_benchmark_snapshot.bin").string();
+    cases.push_back({"snapshot.save", build_once, [snapshot_path, &search_server] {
+        search_server->SaveSnapshot(snapshot_path);
+        remove(snapshot_path.c_str());
+        return static_cast<size_t>(search_server->GetDocumentCount());
+    }});
+    cases.push_back({"snapshot.load",
+        [snapshot_path, build_once, &search_server] {
+            build_once();
+            search_server->SaveSnapshot(snapshot_path);
+        },
+        [snapshot_path, &search_server] {
+            search_server->LoadSnapshot(snapshot_path);
+            remove(snapshot_path.c_str());
+            return static_cast<size_t>(search_server->GetDocumentCount());
+        }});
+    cases.push_back({"match_document.seq", build_once, [&config, &corpus, &search_server] {
+        return MatchDocuments(*search_server, config, corpus, execution::seq);
+    }});
+    cases.push_back({"match_document.par", build_once, [&config, &corpus, &search_server] {
+        return MatchDocuments(*search_server, config, corpus, execution::par);
+    }});
+    cases.push_back({"find_top_documents.seq", build_once, [&corpus, &search_server] {
+        double total_relevance = 0;
+        for (const string& query : corpus.queries) {
+            total_relevance += SumRelevance(search_server->FindTopDocuments(execution::seq, query));
+        }
+        benchmark_sink = benchmark_sink + total_relevance;
+        return corpus.queries.size();
+    }});
+    cases.push_back({"find_top_documents.par", build_once, [&corpus, &search_server] {
+        double total_relevance = 0;
+        for (const string& query : corpus.queries) {
+            total_relevance += SumRelevance(search_server->FindTopDocuments(execution::par, query));
+        }
+        benchmark_sink = benchmark_sink + total_relevance;
+        return corpus.queries.size();
+    }});
+    cases.push_back({"process_queries", build_once, [&corpus, &search_server] {
+        double total_relevance = 0;
+        for (const auto& documents : ProcessQueries(*search_server, corpus.queries)) {
+            total_relevance += SumRelevance(documents);
+        }
+        benchmark_sink = benchmark_sink + total_relevance;
+        return corpus.queries.size();
+    }});
+    // IDF of the plus words as the server computed it before the IDF table, from the document count of the term
+    // found by its id, against the table. Both look the term up by id, the difference is the logarithm
+    const auto idf_lookups = make_shared<IdfLookups>();
+    const auto make_idf_lookups = [&corpus, idf_lookups] {
+        if (idf_lookups->query_term_ids.empty()) {
+            *idf_lookups = MakeIdfLookups(corpus);
+        }
+    };
+    cases.push_back({"idf.log", make_idf_lookups, [idf_lookups] {
+        const IdfLookups& lookups = *idf_lookups;
+        double total_idf = 0;
+        for (int pass = 0; pass < IDF_PASS_COUNT; ++pass) {
+            for (const int term_id : lookups.query_term_ids) {
+                total_idf += log(lookups.document_count * 1.0 / lookups.term_document_counts[term_id]);
+            }
+        }
+        benchmark_sink = benchmark_sink + total_idf;
+        return IDF_PASS_COUNT * lookups.query_term_ids.size();
+    }});
+    cases.push_back({"idf.table", make_idf_lookups, [idf_lookups] {
+        const IdfLookups& lookups = *idf_lookups;
+        double total_idf = 0;
+        for (int pass = 0; pass < IDF_PASS_COUNT; ++pass) {
+            for (const int term_id : lookups.query_term_ids) {
+                total_idf += lookups.idf_table.Get(term_id);
+            }
+        }
+        benchmark_sink = benchmark_sink + total_idf;
+        return IDF_PASS_COUNT * lookups.query_term_ids.size();
+    }});
+    cases.push_back({"remove_duplicates",
+        [&corpus, &search_server] { search_server = BuildServer(corpus, true); },
+        [&search_server] {
+            const size_t document_count = search_server->GetDocumentCount();
+            // RemoveDuplicates reports every duplicate, the report is not benchmarked
+            streambuf* const cout_buffer = cout.rdbuf(nullptr);
+            RemoveDuplicates(*search_server);
+            cout.rdbuf(cout_buffer);
+            cout.clear();
+            return document_count;
+        }});
+    return cases;
+}
+
+// High-water mark of the whole process: it covers every case run so far and never goes down,
+// so it is reported once per run. The memory of a single case is that of a run with --filter selecting it
+long GetPeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+BenchmarkResult RunCase(const BenchmarkCase& benchmark_case, const BenchmarkConfig& config) {
+    using Clock = chrono::steady_clock;
+    BenchmarkResult result;
+    result.name = benchmark_case.name;
+    for (int repetition = 0; repetition < config.warmup + config.repetitions; ++repetition) {
+        benchmark_case.setup();
+        const Clock::time_point start_time = Clock::now();
+        result.operation_count = benchmark_case.run();
+        const chrono::duration<double, nano> duration = Clock::now() - start_time;
+        if (repetition >= config.warmup) {
+            result.samples_ns.push_back(duration.count());
+        }
+    }
+
+    vector<double> sorted_samples = result.samples_ns;
+    sort(sorted_samples.begin(), sorted_samples.end());
+    const size_t count = sorted_samples.size();
+    result.min_ns = sorted_samples.front();
+    result.max_ns = sorted_samples.back();
+    result.median_ns = count % 2 == 1 ? sorted_samples[count / 2] : (sorted_samples[count / 2 - 1] + sorted_samples[count / 2]) / 2;
+    result.mean_ns = accumulate(sorted_samples.begin(), sorted_samples.end(), 0.) / count;
+    double square_sum = 0;
+    for (const double sample : sorted_samples) {
+        square_sum += (sample - result.mean_ns) * (sample - result.mean_ns);
+    }
+    result.stddev_ns = count > 1 ? sqrt(square_sum / (count - 1)) : 0.;
+    return result;
+}
+
+void PrintText(ostream& output, const vector<BenchmarkResult>& results) {
+    output << left << setw(24) << "case" << right << setw(10) << "ops" << setw(14) << "median ms" << setw(14) << "mean ms"
+           << setw(12) << "stddev %" << setw(14) << "min ms" << setw(14) << "max ms" << setw(14) << "ns/op" << '\n';
+    output << fixed << setprecision(3);
+    for (const BenchmarkResult& result : results) {
+        output << left << setw(24) << result.name << right << setw(10) << result.operation_count
+               << setw(14) << result.median_ns / 1e6 << setw(14) << result.mean_ns / 1e6
+               << setw(12) << (result.mean_ns == 0 ? 0. : 100. * result.stddev_ns / result.mean_ns)
+               << setw(14) << result.min_ns / 1e6 << setw(14) << result.max_ns / 1e6
+               << setw(14) << result.median_ns / max<size_t>(result.operation_count, 1) << '\n';
+    }
+    output << defaultfloat << "peak RSS of the run, KB: " << GetPeakRssKb() << '\n';
+}
+
+// One case per line, in a fixed order, so that results diff line by line
+void PrintJson(ostream& output, const BenchmarkConfig& config, const vector<BenchmarkResult>& results) {
+    output << "{\n  \"config\": {\"documents\": " << config.document_count << ", \"vocabulary\": " << config.vocabulary_size
+           << ", \"word_length\": " << config.max_word_length << ", \"document_words\": " << config.document_word_count
+           << ", \"queries\": " << config.query_count << ", \"query_words\": " << config.query_word_count
+           << ", \"minus_prob\": " << config.minus_prob << ", \"removed_share\": " << config.removed_share
+           << ", \"duplicate_share\": " << config.duplicate_share << ", \"matched_per_query\": " << config.matched_documents_per_query
+           << ", \"warmup\": " << config.warmup << ", \"repetitions\": " << config.repetitions << ", \"seed\": " << config.seed << "},\n";
+    output << "  \"cases\": [\n" << fixed << setprecision(0);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        output << "    {\"name\": \"" << result.name << "\", \"operations\": " << result.operation_count
+               << ", \"median_ns\": " << result.median_ns << ", \"mean_ns\": " << result.mean_ns << ", \"stddev_ns\": " << result.stddev_ns
+               << ", \"min_ns\": " << result.min_ns << ", \"max_ns\": " << result.max_ns
+               << ", \"ns_per_operation\": " << result.median_ns / max<size_t>(result.operation_count, 1)
+               << ", \"samples_ns\": [";
+        for (size_t j = 0; j < result.samples_ns.size(); ++j) {
+            output << (j == 0 ? "" : ", ") << result.samples_ns[j];
+        }
+        output << "]}" << (i + 1 == results.size() ? "" : ",") << '\n';
+    }
+    output << defaultfloat << "  ],\n  \"peak_rss_kb\": " << GetPeakRssKb() << "\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    try {
+        config = ParseArguments(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << '\n';
+        PrintUsage(cerr);
+        return 1;
+    }
+
+    const Corpus corpus = GenerateCorpus(config);
+    unique_ptr<SearchServer> search_server;
+    vector<BenchmarkResult> results;
+    for (const BenchmarkCase& benchmark_case : MakeCases(config, corpus, search_server)) {
+        if (benchmark_case.name.find(config.filter) == string::npos) {
+            continue;
+        }
+        results.push_back(RunCase(benchmark_case, config));
+    }
+
+    PrintText(config.json_path == "-" ? cerr : cout, results);
+    if (config.json_path == "-") {
+        PrintJson(cout, config, results);
+    } else if (!config.json_path.empty()) {
+        ofstream output(config.json_path);
+        PrintJson(output, config, results);
+    }
+}
@@ -1,85 +1,117 @@
+#pragma once
+
+//=================================================================================
 #include <algorithm>
-#include <cstdlib>
-#include <future>
-#include <map>
-#include <numeric>
-#include <random>
-#include <string>
-#include <vector>
-#include <mutex>
-#include <execution>
-#include <future>
-#include <execution>
-#include <iterator>
-
-#include "log_duration.h"
-#include "test_framework.h"
-
-using namespace std::string_literals;
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
 
+//=================================================================================
+// Lock-free accumulating hash map for integer keys.
+// Values are only ever added to (Add), which makes open addressing without deletions possible:
+// a slot is claimed by CAS on its key and then updated with an atomic add.
+// Slots are grouped into buckets of one cache line, and probing walks the slots of a bucket first.
+// The table does not grow, so it has to be created with an upper bound of distinct keys.
 template <typename Key, typename Value>
 class ConcurrentMap {
 public:
     static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+    static_assert(std::is_arithmetic_v<Value>, "ConcurrentMap supports only arithmetic values");
 
-    struct Access {
-        std::lock_guard<std::mutex> ref_to_guard;
-        Value& ref_to_value;
-    };
+    // The key value reserved for empty slots
+    inline static constexpr Key EMPTY_KEY = std::numeric_limits<Key>::min();
 
-    explicit ConcurrentMap(size_t bucket_count) : bucket_count(bucket_count), maps(bucket_count), mutexes(bucket_count){ };
+    explicit ConcurrentMap(size_t max_key_count)
+        : slot_count_(ComputeBucketCount(max_key_count) * SLOTS_PER_BUCKET)
+        , buckets_(std::make_unique<Bucket[]>(slot_count_ / SLOTS_PER_BUCKET)) {
+    }
 
-    Access operator[](const Key& key){
-        size_t index = static_cast<size_t>(key) % bucket_count;
-        return {std::lock_guard<std::mutex>(mutexes[index]), maps[index][key]};
-    };
+    // Adds value to the value of key, inserting key with a zero value first if needed
+    void Add(Key key, Value value){
+        AtomicAdd(FindValue(key), value);
+    }
 
-    size_t erase(const Value& val){
-        size_t cnt = 0;
-        for (size_t i = 0; i < maps.size(); ++i)
-        {
-            std::lock_guard lg(mutexes[i]);
-            cnt += maps[i].erase(val);
+    // Calls function(key, value) for every key. Should not run concurrently with Add
+    template <typename Function>
+    void ForEach(Function function) const {
+        for (size_t i = 0; i < slot_count_ / SLOTS_PER_BUCKET; ++i){
+            const Bucket& bucket = buckets_[i];
+            for (size_t j = 0; j < SLOTS_PER_BUCKET; ++j){
+                const Key key = bucket.keys[j].load(std::memory_order_relaxed);
+                if (key != EMPTY_KEY){
+                    function(key, bucket.values[j].load(std::memory_order_relaxed));
+                }
+            }
         }
+    }
+
+    size_t size() const {
+        size_t cnt = 0;
+        ForEach([&cnt](Key, Value){ ++cnt; });
         return cnt;
     }
 
-    std::map<Key, Value> BuildOrdinaryMap(){
-        std::map<Key, Value> res;
-        for (size_t i = 0; i < maps.size(); ++i)
-        {
-            std::lock_guard lg(mutexes[i]);
-            res.insert(maps[i].begin(), maps[i].end());
+private:
+    inline static constexpr size_t CACHE_LINE_SIZE = 64;
+    inline static constexpr size_t SLOTS_PER_BUCKET = std::max<size_t>(1, CACHE_LINE_SIZE / (sizeof(Key) + sizeof(Value)));
+
+    struct alignas(CACHE_LINE_SIZE) Bucket {
+        Bucket() {
+            for (size_t i = 0; i < SLOTS_PER_BUCKET; ++i){
+                keys[i].store(EMPTY_KEY, std::memory_order_relaxed);
+                values[i].store(Value{}, std::memory_order_relaxed);
+            }
         }
-        return res;
+
+        std::atomic<Key> keys[SLOTS_PER_BUCKET];
+        std::atomic<Value> values[SLOTS_PER_BUCKET];
     };
 
-    size_t size(){
-        size_t cnt = 0;
-        for (const auto& map : maps){
-            cnt += map.size();
-        }
-        return cnt;
-    }
+    size_t slot_count_;
+    std::unique_ptr<Bucket[]> buckets_;
 
-    const std::map<Key, Value>* cbegin(){
-        return maps.cbegin();
+    static size_t ComputeBucketCount(size_t max_key_count){
+        // Keep the load factor at most 1/2 so that probe sequences stay short
+        const size_t slot_count = std::max<size_t>(1, max_key_count * 2);
+        return (slot_count + SLOTS_PER_BUCKET - 1) / SLOTS_PER_BUCKET;
     }
 
-    const std::map<Key, Value>* cend(){
-        return maps.cend();
+    static size_t Hash(Key key){
+        // Fibonacci hashing spreads dense keys over the whole table
+        return static_cast<size_t>(static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull >> 16);
     }
 
-    std::map<Key, Value>* begin(){
-        return maps.begin();
-    }
+    std::atomic<Value>& FindValue(Key key){
+        if (key == EMPTY_KEY){
+            throw std::invalid_argument("ConcurrentMap key is reserved for empty slots");
+        }
+        size_t index = Hash(key) % slot_count_;
+        for (size_t probe = 0; probe < slot_count_; ++probe){
+            Bucket& bucket = buckets_[index / SLOTS_PER_BUCKET];
+            std::atomic<Key>& slot_key = bucket.keys[index % SLOTS_PER_BUCKET];
 
-    std::map<Key, Value>* end(){
-        return maps.end();
+            Key current = slot_key.load(std::memory_order_acquire);
+            if (current == EMPTY_KEY && slot_key.compare_exchange_strong(current, key, std::memory_order_acq_rel)){
+                return bucket.values[index % SLOTS_PER_BUCKET];
+            }
+            if (current == key){
+                return bucket.values[index % SLOTS_PER_BUCKET];
+            }
+            index = index + 1 == slot_count_ ? 0 : index + 1;
+        }
+        throw std::overflow_error("ConcurrentMap has more keys than it was created for");
     }
 
-private:
-    size_t bucket_count;
-    std::vector<std::map<Key, Value>> maps;
-    std::vector<std::mutex> mutexes;
+    static void AtomicAdd(std::atomic<Value>& target, Value value){
+        if constexpr (std::is_integral_v<Value>){
+            target.fetch_add(value, std::memory_order_relaxed);
+        } else {
+            Value expected = target.load(std::memory_order_relaxed);
+            while (!target.compare_exchange_weak(expected, expected + value, std::memory_order_relaxed)){
+            }
+        }
+    }
 };
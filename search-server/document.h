@@ -2,6 +2,8 @@
 
 //=================================================================================
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 //=================================================================================
 struct Document {
@@ -21,3 +23,12 @@ enum class DocumentStatus {
     BANNED,
     REMOVED,
 };
+
+//=================================================================================
+// A document to be indexed by SearchServer::AddDocuments
+struct RawDocument {
+    int id;
+    std::string_view text;
+    DocumentStatus status;
+    std::vector<int> ratings;
+};
@@ -0,0 +1,209 @@
+#include "document_bitmap.h"
+
+//=================================================================================
+#include <utility>
+
+//=================================================================================
+namespace {
+
+// Sets the bit of the low 16 bits of ordinal in a dense chunk, returns 1 if it was not set
+inline size_t SetBit(uint64_t* bits, int ordinal)
+{
+    const uint16_t low = static_cast<uint16_t>(ordinal);
+    const uint64_t mask = uint64_t{1} << (low % 64);
+    const size_t added = (bits[low / 64] & mask) == 0;
+    bits[low / 64] |= mask;
+    return added;
+}
+
+}
+
+//=================================================================================
+DocumentBitmap::DocumentBitmap(DocumentBitmap &&other) noexcept
+    : chunks_(std::move(other.chunks_))
+    , chunk_count_(std::exchange(other.chunk_count_, 0))
+    , size_(std::exchange(other.size_, 0))
+{
+    other.chunks_.clear();
+}
+
+//=================================================================================
+DocumentBitmap &DocumentBitmap::operator=(DocumentBitmap &&other) noexcept
+{
+    if (this != &other){
+        chunks_ = std::move(other.chunks_);
+        other.chunks_.clear();
+        chunk_count_ = std::exchange(other.chunk_count_, 0);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+//=================================================================================
+void DocumentBitmap::Add(int ordinal)
+{
+    const uint32_t value = static_cast<uint32_t>(ordinal);
+    Chunk& chunk = GetChunk(value >> CHUNK_BITS);
+    const uint16_t low = static_cast<uint16_t>(value);
+
+    if (chunk.is_dense){
+        if (!SetBit(chunk.bits.data(), ordinal)){
+            return;
+        }
+    } else if (chunk.values.empty() || chunk.values.back() < low){
+        // Ordinals mostly come in increasing order
+        chunk.values.push_back(low);
+    } else {
+        const auto iter = std::lower_bound(chunk.values.begin(), chunk.values.end(), low);
+        if (*iter == low){
+            return;
+        }
+        chunk.values.insert(iter, low);
+    }
+    ++chunk.size;
+    ++size_;
+    if (!chunk.is_dense && chunk.size > MAX_SPARSE_SIZE){
+        MakeDense(chunk);
+    }
+}
+
+//=================================================================================
+void DocumentBitmap::Add(const int *ordinals, size_t count)
+{
+    for (size_t begin = 0; begin < count;){
+        const size_t chunk_index = static_cast<uint32_t>(ordinals[begin]) >> CHUNK_BITS;
+        size_t end = count;
+        if ((static_cast<uint32_t>(ordinals[count - 1]) >> CHUNK_BITS) != chunk_index){
+            end = begin + 1;
+            while ((static_cast<uint32_t>(ordinals[end]) >> CHUNK_BITS) == chunk_index){
+                ++end;
+            }
+        }
+        Chunk& chunk = GetChunk(chunk_index);
+        const size_t old_size = chunk.size;
+
+        if (!chunk.is_dense && chunk.size + (end - begin) > MAX_SPARSE_SIZE){
+            MakeDense(chunk);
+        }
+        if (chunk.is_dense){
+            // Consecutive ordinals often share a word and every update waits for the previous one,
+            // so four quarters of the run are interleaved to keep independent updates in flight
+            uint64_t* bits = chunk.bits.data();
+            const int* run = ordinals + begin;
+            const size_t run_size = end - begin;
+            const size_t quarter = run_size / 4;
+            size_t added_count = 0;
+            for (size_t i = 0; i < quarter; ++i){
+                added_count += SetBit(bits, run[i]) + SetBit(bits, run[quarter + i])
+                        + SetBit(bits, run[2 * quarter + i]) + SetBit(bits, run[3 * quarter + i]);
+            }
+            for (size_t i = 4 * quarter; i < run_size; ++i){
+                added_count += SetBit(bits, run[i]);
+            }
+            chunk.size += added_count;
+        } else {
+            // Merged from the back into the grown array; duplicates leave a gap at the front, closed afterwards
+            std::vector<uint16_t>& values = chunk.values;
+            size_t left = values.size();
+            size_t right = end;
+            values.resize(values.size() + (end - begin));
+            size_t out = values.size();
+            while (right > begin){
+                const uint16_t low = static_cast<uint16_t>(ordinals[right - 1]);
+                if (left > 0 && values[left - 1] >= low){
+                    right -= values[left - 1] == low;
+                    values[--out] = values[--left];
+                } else {
+                    values[--out] = low;
+                    --right;
+                }
+            }
+            if (out > left){
+                values.erase(values.begin() + left, values.begin() + out);
+            }
+            chunk.size = values.size();
+        }
+        size_ += chunk.size - old_size;
+        begin = end;
+    }
+}
+
+//=================================================================================
+void DocumentBitmap::Remove(int ordinal)
+{
+    const uint32_t value = static_cast<uint32_t>(ordinal);
+    const size_t chunk_index = value >> CHUNK_BITS;
+    if (chunk_index >= chunk_count_){
+        return;
+    }
+    Chunk& chunk = chunks_[chunk_index];
+    const uint16_t low = static_cast<uint16_t>(value);
+
+    if (chunk.is_dense){
+        uint64_t& word = chunk.bits[low / 64];
+        const uint64_t mask = uint64_t{1} << (low % 64);
+        if (!(word & mask)){
+            return;
+        }
+        word &= ~mask;
+    } else {
+        const auto iter = std::lower_bound(chunk.values.begin(), chunk.values.end(), low);
+        if (iter == chunk.values.end() || *iter != low){
+            return;
+        }
+        chunk.values.erase(iter);
+    }
+    --chunk.size;
+    --size_;
+    // Half the threshold, so that a chunk near it does not switch back and forth
+    if (chunk.is_dense && chunk.size <= MAX_SPARSE_SIZE / 2){
+        MakeSparse(chunk);
+    }
+}
+
+//=================================================================================
+void DocumentBitmap::Clear()
+{
+    for (size_t i = 0; i < chunk_count_; ++i){
+        chunks_[i].values.clear();
+        chunks_[i].size = 0;
+        chunks_[i].is_dense = false;
+    }
+    chunk_count_ = 0;
+    size_ = 0;
+}
+
+//=================================================================================
+DocumentBitmap::Chunk &DocumentBitmap::GetChunk(size_t chunk_index)
+{
+    if (chunk_index >= chunk_count_){
+        if (chunks_.size() <= chunk_index){
+            chunks_.resize(chunk_index + 1);
+        }
+        chunk_count_ = chunk_index + 1;
+    }
+    return chunks_[chunk_index];
+}
+
+//=================================================================================
+void DocumentBitmap::MakeDense(Chunk &chunk)
+{
+    chunk.bits.assign(CHUNK_SIZE / 64, 0);
+    for (const uint16_t low : chunk.values){
+        chunk.bits[low / 64] |= uint64_t{1} << (low % 64);
+    }
+    chunk.values.clear();
+    chunk.is_dense = true;
+}
+
+//=================================================================================
+void DocumentBitmap::MakeSparse(Chunk &chunk)
+{
+    chunk.values.clear();
+    for (size_t word = 0; word < chunk.bits.size(); ++word){
+        for (uint64_t bits = chunk.bits[word]; bits != 0; bits &= bits - 1){
+            chunk.values.push_back(static_cast<uint16_t>(word * 64 + __builtin_ctzll(bits)));
+        }
+    }
+    chunk.is_dense = false;
+}
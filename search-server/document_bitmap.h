@@ -0,0 +1,82 @@
+#pragma once
+
+//=================================================================================
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//=================================================================================
+// Compressed set of document ordinals in the manner of Roaring bitmaps: ordinals are split into chunks of 2^16,
+// a chunk keeps its low 16 bits in a sorted array while sparse and switches to a plain bitset when dense.
+// Ordinals are dense from 0, so chunks are indexed directly rather than through a sorted key array.
+// Clear keeps the storage, so a bitmap rebuilt for every query stops allocating once warmed up
+class DocumentBitmap {
+public:
+    DocumentBitmap() = default;
+    DocumentBitmap(const DocumentBitmap&) = default;
+    DocumentBitmap& operator=(const DocumentBitmap&) = default;
+    // The moved-from bitmap is empty
+    DocumentBitmap(DocumentBitmap&& other) noexcept;
+    DocumentBitmap& operator=(DocumentBitmap&& other) noexcept;
+
+    void Add(int ordinal);
+    // Adds a run of ordinals in strictly increasing order, merging it into every chunk at once
+    void Add(const int* ordinals, size_t count);
+    void Remove(int ordinal);
+    bool Contains(int ordinal) const;
+    // Empties the bitmap, keeping its storage
+    void Clear();
+
+    size_t size() const;
+    bool empty() const;
+
+private:
+    inline static constexpr uint32_t CHUNK_BITS = 16;
+    inline static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+    // A sparse chunk of this many ordinals takes as much memory as a bitset
+    inline static constexpr size_t MAX_SPARSE_SIZE = CHUNK_SIZE / 16;
+
+    struct Chunk {
+        std::vector<uint16_t> values;   // sorted, while the chunk is sparse
+        std::vector<uint64_t> bits;     // CHUNK_SIZE bits, while the chunk is dense; kept allocated once used
+        size_t size = 0;
+        bool is_dense = false;
+    };
+
+    std::vector<Chunk> chunks_;         // may hold cleared chunks past chunk_count_ for reuse
+    size_t chunk_count_ = 0;
+    size_t size_ = 0;
+
+    Chunk& GetChunk(size_t chunk_index);
+    static void MakeDense(Chunk& chunk);
+    static void MakeSparse(Chunk& chunk);
+};
+
+//=================================================================================
+inline bool DocumentBitmap::Contains(int ordinal) const
+{
+    const uint32_t value = static_cast<uint32_t>(ordinal);
+    const size_t chunk_index = value >> CHUNK_BITS;
+    if (chunk_index >= chunk_count_){
+        return false;
+    }
+    const Chunk& chunk = chunks_[chunk_index];
+    const uint16_t low = static_cast<uint16_t>(value);
+    if (chunk.is_dense){
+        return (chunk.bits[low / 64] >> (low % 64)) & 1;
+    }
+    return std::binary_search(chunk.values.begin(), chunk.values.end(), low);
+}
+
+//=================================================================================
+inline size_t DocumentBitmap::size() const
+{
+    return size_;
+}
+
+//=================================================================================
+inline bool DocumentBitmap::empty() const
+{
+    return size_ == 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+//=================================================================================
+#include <random>
+#include <string>
+#include <vector>
+
+//=================================================================================
+// Random corpora and queries for benchmarks. The same generator state gives the same texts
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+// Words of 1 to max_length random letters, adjacent duplicates removed
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+// word_count words of the dictionary separated by spaces, each a minus word with probability minus_prob
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+
+// Serve as document texts too, with minus_prob 0
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count,
+                                         double minus_prob = 0);
@@ -0,0 +1,98 @@
+#include "document_id_index.h"
+
+//=================================================================================
+#include <algorithm>
+
+//=================================================================================
+DocumentIdIndex::DocumentIdIndex(DocumentIdIndex &&other) noexcept
+    : ids_(std::move(other.ids_))
+    , inserted_ids_(std::move(other.inserted_ids_))
+    , erased_ids_(std::move(other.erased_ids_))
+    , size_(other.size_)
+    , has_queued_changes_(other.has_queued_changes_.load())
+{
+    other.size_ = 0;
+    other.has_queued_changes_ = false;
+}
+
+//=================================================================================
+DocumentIdIndex &DocumentIdIndex::operator=(DocumentIdIndex &&other) noexcept
+{
+    ids_ = std::move(other.ids_);
+    inserted_ids_ = std::move(other.inserted_ids_);
+    erased_ids_ = std::move(other.erased_ids_);
+    size_ = other.size_;
+    has_queued_changes_ = other.has_queued_changes_.load();
+    other.size_ = 0;
+    other.has_queued_changes_ = false;
+    return *this;
+}
+
+//=================================================================================
+void DocumentIdIndex::Insert(int document_id)
+{
+    ++size_;
+    // Ids usually come in increasing order; ids_ stays sorted whatever is queued
+    if (ids_.empty() || ids_.back() < document_id){
+        ids_.push_back(document_id);
+        return;
+    }
+    inserted_ids_.push_back(document_id);
+    has_queued_changes_.store(true, std::memory_order_relaxed);
+}
+
+//=================================================================================
+void DocumentIdIndex::Erase(int document_id)
+{
+    --size_;
+    erased_ids_.push_back(document_id);
+    has_queued_changes_.store(true, std::memory_order_relaxed);
+}
+
+//=================================================================================
+void DocumentIdIndex::Assign(std::vector<int> document_ids)
+{
+    std::sort(document_ids.begin(), document_ids.end());
+    ids_ = std::move(document_ids);
+    inserted_ids_.clear();
+    erased_ids_.clear();
+    size_ = ids_.size();
+    has_queued_changes_ = false;
+}
+
+//=================================================================================
+void DocumentIdIndex::MergeQueuedChanges() const
+{
+    std::lock_guard guard(merge_mutex_);
+    if (!has_queued_changes_.load(std::memory_order_relaxed)){
+        return;
+    }
+
+    // An id erased and inserted again is queued in both lists: insertions go first,
+    // then every queued erasure removes one occurrence
+    if (!inserted_ids_.empty()){
+        std::sort(inserted_ids_.begin(), inserted_ids_.end());
+        const auto middle = ids_.insert(ids_.end(), inserted_ids_.begin(), inserted_ids_.end());
+        std::inplace_merge(ids_.begin(), middle, ids_.end());
+        inserted_ids_.clear();
+    }
+    if (!erased_ids_.empty()){
+        std::sort(erased_ids_.begin(), erased_ids_.end());
+        // Ids before the smallest erased one keep their places
+        auto output = std::lower_bound(ids_.begin(), ids_.end(), erased_ids_.front());
+        auto erased = erased_ids_.cbegin();
+        for (auto input = output; input != ids_.end(); ++input){
+            while (erased != erased_ids_.cend() && *erased < *input){
+                ++erased;
+            }
+            if (erased != erased_ids_.cend() && *erased == *input){
+                ++erased;
+                continue;
+            }
+            *output++ = *input;
+        }
+        ids_.erase(output, ids_.end());
+        erased_ids_.clear();
+    }
+    has_queued_changes_.store(false, std::memory_order_release);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+//=================================================================================
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+//=================================================================================
+// Ids of the live documents in increasing order, the index of GetDocumentId and begin()/end().
+// An id greater than all others is appended. Other insertions and all erasures are queued and merged
+// into the sorted ids in one pass by the first read after them, so a run of changes costs one pass
+// instead of a shift of the whole vector per id. Reads may run concurrently with each other, not with changes
+class DocumentIdIndex {
+public:
+    DocumentIdIndex() = default;
+    DocumentIdIndex(DocumentIdIndex&& other) noexcept;
+    DocumentIdIndex& operator=(DocumentIdIndex&& other) noexcept;
+
+    // The id must not be in the index
+    void Insert(int document_id);
+    // The id must be in the index
+    void Erase(int document_id);
+    // Replaces the contents, the ids may come in any order
+    void Assign(std::vector<int> document_ids);
+
+    size_t size() const;
+    int operator[](size_t index) const;
+    std::vector<int>::const_iterator begin() const;
+    std::vector<int>::const_iterator end() const;
+
+private:
+    // Sorted; may still hold queued erasures and lack queued insertions
+    mutable std::vector<int> ids_;
+    mutable std::vector<int> inserted_ids_;
+    mutable std::vector<int> erased_ids_;
+    size_t size_ = 0;
+    mutable std::atomic<bool> has_queued_changes_ = false;
+    mutable std::mutex merge_mutex_;
+
+    const std::vector<int>& GetSortedIds() const;
+    void MergeQueuedChanges() const;
+};
+
+//=================================================================================
+inline size_t DocumentIdIndex::size() const
+{
+    return size_;
+}
+
+//=================================================================================
+inline int DocumentIdIndex::operator[](size_t index) const
+{
+    return GetSortedIds()[index];
+}
+
+//=================================================================================
+inline std::vector<int>::const_iterator DocumentIdIndex::begin() const
+{
+    return GetSortedIds().cbegin();
+}
+
+//=================================================================================
+inline std::vector<int>::const_iterator DocumentIdIndex::end() const
+{
+    return GetSortedIds().cend();
+}
+
+//=================================================================================
+inline const std::vector<int>& DocumentIdIndex::GetSortedIds() const
+{
+    if (has_queued_changes_.load(std::memory_order_acquire)){
+        MergeQueuedChanges();
+    }
+    return ids_;
+}
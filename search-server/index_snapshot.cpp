@@ -0,0 +1,279 @@
+#include "index_snapshot.h"
+
+//=================================================================================
+#include <algorithm>
+#include <cstdio>
+
+//=================================================================================
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//=================================================================================
+namespace {
+
+// Replaces the file at path with the one at source_path in a single step: a reader of path
+// sees either the old file or the new one
+bool ReplaceFile(const std::string& source_path, const std::string& path)
+{
+#ifdef _WIN32
+    return MoveFileExA(source_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(source_path.c_str(), path.c_str()) == 0;
+#endif
+}
+
+}
+
+//=================================================================================
+uint64_t SnapshotChecksum::Mix(uint64_t lane, uint64_t word)
+{
+    lane = (lane ^ word) * 0x9e3779b97f4a7c15ull;
+    return lane ^ (lane >> 32);
+}
+
+//=================================================================================
+void SnapshotChecksum::MixStripe(const char *stripe)
+{
+    for (size_t lane = 0; lane < LANE_COUNT; ++lane){
+        uint64_t word;
+        std::memcpy(&word, stripe + lane * sizeof(uint64_t), sizeof(word));
+        lanes_[lane] = Mix(lanes_[lane], word);
+    }
+}
+
+//=================================================================================
+void SnapshotChecksum::Update(const char *data, size_t size)
+{
+    size_ += size;
+    if (carry_size_ > 0){
+        const size_t taken = std::min(size, STRIPE_SIZE - carry_size_);
+        std::memcpy(carry_ + carry_size_, data, taken);
+        carry_size_ += taken;
+        data += taken;
+        size -= taken;
+        if (carry_size_ < STRIPE_SIZE){
+            return;
+        }
+        MixStripe(carry_);
+        carry_size_ = 0;
+    }
+    for (; size >= STRIPE_SIZE; data += STRIPE_SIZE, size -= STRIPE_SIZE){
+        MixStripe(data);
+    }
+    if (size > 0){
+        std::memcpy(carry_, data, size);
+    }
+    carry_size_ = size;
+}
+
+//=================================================================================
+uint64_t SnapshotChecksum::GetValue() const
+{
+    // The incomplete stripe is padded with zeros, the size tells the padding from data
+    SnapshotChecksum final_checksum = *this;
+    std::memset(final_checksum.carry_ + carry_size_, 0, STRIPE_SIZE - carry_size_);
+    final_checksum.MixStripe(final_checksum.carry_);
+    uint64_t value = size_;
+    for (const uint64_t lane : final_checksum.lanes_){
+        value = Mix(value, lane);
+    }
+    return value;
+}
+
+//=================================================================================
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &path)
+{
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE){
+        file_ = nullptr;
+        throw std::runtime_error("can't open snapshot: " + path);
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_, &file_size)){
+        CloseHandle(file_);
+        throw std::runtime_error("can't get snapshot size: " + path);
+    }
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    if (size_ == 0){
+        return;
+    }
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr){
+        CloseHandle(file_);
+        throw std::runtime_error("can't map snapshot: " + path);
+    }
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr){
+        CloseHandle(mapping_);
+        CloseHandle(file_);
+        throw std::runtime_error("can't map snapshot: " + path);
+    }
+}
+
+//=================================================================================
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr){
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_ != nullptr){
+        CloseHandle(mapping_);
+    }
+    if (file_ != nullptr){
+        CloseHandle(file_);
+    }
+}
+#else
+MappedFile::MappedFile(const std::string &path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        throw std::runtime_error("can't open snapshot: " + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0){
+        close(fd);
+        throw std::runtime_error("can't get snapshot size: " + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0){
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("can't map snapshot: " + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+//=================================================================================
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr){
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+#endif
+
+//=================================================================================
+const char *MappedFile::data() const
+{
+    return data_;
+}
+
+//=================================================================================
+size_t MappedFile::size() const
+{
+    return size_;
+}
+
+//=================================================================================
+SnapshotWriter::SnapshotWriter(const std::string &path)
+    : path_(path)
+    , temp_path_(path + ".tmp")
+    , out_(temp_path_, std::ios::binary | std::ios::trunc)
+{
+    if (!out_){
+        throw std::runtime_error("can't create snapshot: " + temp_path_);
+    }
+    // Reserve room for the header, it is written by Finish
+    const SnapshotHeader header{};
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+//=================================================================================
+void SnapshotWriter::WriteBytes(const char *data, size_t size)
+{
+    out_.write(data, size);
+    payload_size_ += size;
+    checksum_.Update(data, size);
+}
+
+//=================================================================================
+void SnapshotWriter::Finish()
+{
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_FORMAT_VERSION;
+    header.byte_order_mark = SNAPSHOT_BYTE_ORDER_MARK;
+    header.payload_size = payload_size_;
+    header.checksum = checksum_.GetValue();
+
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.flush();
+    out_.close();
+    if (!out_){
+        throw std::runtime_error("can't write snapshot: " + temp_path_);
+    }
+    if (!ReplaceFile(temp_path_, path_)){
+        throw std::runtime_error("can't replace snapshot: " + path_);
+    }
+    is_finished_ = true;
+}
+
+//=================================================================================
+SnapshotWriter::~SnapshotWriter()
+{
+    // An unfinished snapshot never replaces the previous one
+    if (!is_finished_){
+        out_.close();
+        std::remove(temp_path_.c_str());
+    }
+}
+
+//=================================================================================
+SnapshotReader::SnapshotReader(const MappedFile &file)
+{
+    SnapshotHeader header;
+    if (file.size() < sizeof(header)){
+        throw std::runtime_error("snapshot is truncated");
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0){
+        throw std::runtime_error("file is not a search server snapshot");
+    }
+    if (header.byte_order_mark != SNAPSHOT_BYTE_ORDER_MARK){
+        throw std::runtime_error("snapshot was written with another byte order");
+    }
+    if (header.version != SNAPSHOT_FORMAT_VERSION){
+        throw std::runtime_error("unsupported snapshot version: " + std::to_string(header.version));
+    }
+    if (header.payload_size != file.size() - sizeof(header)){
+        throw std::runtime_error("snapshot is truncated");
+    }
+
+    pos_ = file.data() + sizeof(header);
+    end_ = pos_ + header.payload_size;
+    SnapshotChecksum checksum;
+    checksum.Update(pos_, header.payload_size);
+    if (checksum.GetValue() != header.checksum){
+        throw std::runtime_error("snapshot checksum mismatch");
+    }
+}
+
+//=================================================================================
+const char *SnapshotReader::ReadBytes(size_t size)
+{
+    if (size > static_cast<size_t>(end_ - pos_)){
+        throw std::runtime_error("snapshot is truncated");
+    }
+    const char* data = pos_;
+    pos_ += size;
+    return data;
+}
+
+//=================================================================================
+bool SnapshotReader::IsAtEnd() const
+{
+    return pos_ == end_;
+}
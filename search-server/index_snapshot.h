@@ -0,0 +1,161 @@
+#pragma once
+
+//=================================================================================
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+//=================================================================================
+// Binary index snapshot file:
+//   header  : magic[8], format version (u32), byte order mark (u32), payload size (u64), payload checksum (u64)
+//   payload : sections written by SearchServer::SaveSnapshot
+// All values are fixed-width and stored in the byte order of the writer (checked by the mark),
+// the file contains no pointers, only sizes and indices.
+//=================================================================================
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+inline constexpr char SNAPSHOT_MAGIC[8] = {'S', 'S', 'R', 'V', 'I', 'D', 'X', '\0'};
+inline constexpr uint32_t SNAPSHOT_FORMAT_VERSION = 4;
+inline constexpr uint32_t SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+
+//=================================================================================
+// Checksum of the payload, fed in pieces of any size. Stripes of LANE_COUNT 8-byte words are mixed into
+// independent lanes with a multiplication per word, so a snapshot is verified at memory speed rather than
+// a byte at a time. The result depends only on the bytes, not on how they were split into pieces
+class SnapshotChecksum {
+public:
+    void Update(const char* data, size_t size);
+    uint64_t GetValue() const;
+
+private:
+    inline static constexpr size_t LANE_COUNT = 4;
+    inline static constexpr size_t STRIPE_SIZE = LANE_COUNT * sizeof(uint64_t);
+
+    uint64_t lanes_[LANE_COUNT] = {0xcbf29ce484222325ull, 0x84222325cbf29ce4ull, 0x9ce484222325cbf2ull, 0x2325cbf29ce48422ull};
+    uint64_t size_ = 0;
+    char carry_[STRIPE_SIZE] = {};      // bytes of an incomplete stripe
+    size_t carry_size_ = 0;
+
+    static uint64_t Mix(uint64_t lane, uint64_t word);
+    void MixStripe(const char* stripe);
+};
+
+//=================================================================================
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const;
+    size_t size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+//=================================================================================
+// Writes the payload to path + ".tmp", then fills in the header with its size and checksum.
+// Finish renames the complete file over path, so a crash or an I/O error while writing
+// leaves the previous snapshot as it was
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+    // Removes the temporary file if Finish was not reached
+    ~SnapshotWriter();
+
+    template <typename T>
+    void Write(const T& value);
+    template <typename T>
+    void WriteArray(const T* values, size_t count);
+    void WriteBytes(const char* data, size_t size);
+
+    void Finish();
+
+private:
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    bool is_finished_ = false;
+    uint64_t payload_size_ = 0;
+    SnapshotChecksum checksum_;
+};
+
+//=================================================================================
+// Checks the header and the checksum, then reads the payload straight from the mapped file
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const MappedFile& file);
+
+    template <typename T>
+    T Read();
+    template <typename T>
+    void ReadArray(T* values, size_t count);
+    // Returns a pointer into the mapped file
+    const char* ReadBytes(size_t size);
+
+    bool IsAtEnd() const;
+
+private:
+    const char* pos_;
+    const char* end_;
+};
+
+//=================================================================================
+template <typename T>
+void SnapshotWriter::Write(const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    WriteBytes(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+//=================================================================================
+template <typename T>
+void SnapshotWriter::WriteArray(const T* values, size_t count)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    WriteBytes(reinterpret_cast<const char*>(values), sizeof(T) * count);
+}
+
+//=================================================================================
+template <typename T>
+T SnapshotReader::Read()
+{
+    T value;
+    ReadArray(&value, 1);
+    return value;
+}
+
+//=================================================================================
+template <typename T>
+void SnapshotReader::ReadArray(T* values, size_t count)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (count == 0){
+        return;
+    }
+    if (count > static_cast<size_t>(end_ - pos_) / sizeof(T)){
+        throw std::runtime_error("snapshot is truncated");
+    }
+    std::memcpy(values, ReadBytes(sizeof(T) * count), sizeof(T) * count);
+}
@@ -0,0 +1,236 @@
+#include "metrics.h"
+
+//=================================================================================
+#include <algorithm>
+#include <cmath>
+
+//=================================================================================
+namespace metrics_detail {
+
+size_t GetCurrentThreadShard()
+{
+    static std::atomic<size_t> next_shard = 0;
+    thread_local const size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    return shard;
+}
+
+}
+
+//=================================================================================
+namespace {
+
+constexpr double PRINTED_PERCENTILES[] = {50., 90., 99., 99.9};
+
+void PrintJsonString(std::ostream& output, std::string_view text)
+{
+    output << '"';
+    for (const char c : text){
+        if (c == '"' || c == '\\'){
+            output << '\\';
+        }
+        output << c;
+    }
+    output << '"';
+}
+
+// 99.9 -> p999
+std::string GetPercentileName(double percentile)
+{
+    std::string digits = std::to_string(percentile);
+    digits.erase(digits.find_last_not_of('0') + 1);
+    digits.erase(std::remove(digits.begin(), digits.end(), '.'), digits.end());
+    return "p" + digits;
+}
+
+}
+
+//=================================================================================
+uint64_t MetricCounter::Get() const
+{
+    uint64_t value = 0;
+    for (const Shard& shard : shards_){
+        value += shard.value.load(std::memory_order_relaxed);
+    }
+    return value;
+}
+
+//=================================================================================
+void MetricCounter::Reset()
+{
+    for (Shard& shard : shards_){
+        shard.value.store(0, std::memory_order_relaxed);
+    }
+}
+
+//=================================================================================
+double HistogramSnapshot::GetMean() const
+{
+    return count == 0 ? 0. : static_cast<double>(sum) / count;
+}
+
+//=================================================================================
+uint64_t HistogramSnapshot::GetValueAtPercentile(double percentile) const
+{
+    if (count == 0){
+        return 0;
+    }
+    const uint64_t rank = std::clamp<uint64_t>(static_cast<uint64_t>(std::ceil(percentile / 100. * count)), 1, count);
+    uint64_t seen_count = 0;
+    for (size_t i = 0; i < bucket_counts.size(); ++i){
+        seen_count += bucket_counts[i];
+        if (seen_count >= rank){
+            return std::min(LatencyHistogram::GetBucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+//=================================================================================
+LatencyHistogram::LatencyHistogram() : shards_(std::make_unique<Shard[]>(metrics_detail::SHARD_COUNT)) {}
+
+//=================================================================================
+HistogramSnapshot LatencyHistogram::GetSnapshot() const
+{
+    HistogramSnapshot snapshot;
+    snapshot.bucket_counts.assign(BUCKET_COUNT, 0);
+    for (size_t shard_index = 0; shard_index < metrics_detail::SHARD_COUNT; ++shard_index){
+        const Shard& shard = shards_[shard_index];
+        for (size_t i = 0; i < BUCKET_COUNT; ++i){
+            const uint64_t bucket_count = shard.bucket_counts[i].load(std::memory_order_relaxed);
+            snapshot.bucket_counts[i] += bucket_count;
+            snapshot.count += bucket_count;
+        }
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        snapshot.max = std::max(snapshot.max, shard.max.load(std::memory_order_relaxed));
+    }
+    return snapshot;
+}
+
+//=================================================================================
+void LatencyHistogram::Reset()
+{
+    for (size_t shard_index = 0; shard_index < metrics_detail::SHARD_COUNT; ++shard_index){
+        Shard& shard = shards_[shard_index];
+        for (std::atomic<uint64_t>& bucket_count : shard.bucket_counts){
+            bucket_count.store(0, std::memory_order_relaxed);
+        }
+        shard.sum.store(0, std::memory_order_relaxed);
+        shard.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+//=================================================================================
+uint64_t LatencyHistogram::GetBucketLowerBound(size_t bucket_index)
+{
+    if (bucket_index < SUB_BUCKET_COUNT){
+        return bucket_index;
+    }
+    const int shift = static_cast<int>(bucket_index / SUB_BUCKET_COUNT) - 1;
+    return (SUB_BUCKET_COUNT + bucket_index % SUB_BUCKET_COUNT) << shift;
+}
+
+//=================================================================================
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket_index)
+{
+    if (bucket_index + 1 == BUCKET_COUNT){
+        return UINT64_MAX;
+    }
+    return GetBucketLowerBound(bucket_index + 1) - 1;
+}
+
+//=================================================================================
+void MetricsSnapshot::PrintText(std::ostream &output) const
+{
+    for (const auto& [name, value] : counters){
+        output << name << ' ' << value << '\n';
+    }
+    for (const auto& [name, histogram] : histograms){
+        output << name << " count " << histogram.count << " mean " << static_cast<uint64_t>(histogram.GetMean());
+        for (const double percentile : PRINTED_PERCENTILES){
+            output << ' ' << GetPercentileName(percentile) << ' ' << histogram.GetValueAtPercentile(percentile);
+        }
+        output << " max " << histogram.max << '\n';
+    }
+}
+
+//=================================================================================
+void MetricsSnapshot::PrintJson(std::ostream &output) const
+{
+    output << "{\"counters\":{";
+    bool is_first = true;
+    for (const auto& [name, value] : counters){
+        output << (is_first ? "" : ",");
+        PrintJsonString(output, name);
+        output << ':' << value;
+        is_first = false;
+    }
+    output << "},\"histograms\":{";
+    is_first = true;
+    for (const auto& [name, histogram] : histograms){
+        output << (is_first ? "" : ",");
+        PrintJsonString(output, name);
+        output << ":{\"count\":" << histogram.count << ",\"sum\":" << histogram.sum
+               << ",\"mean\":" << histogram.GetMean() << ",\"max\":" << histogram.max;
+        for (const double percentile : PRINTED_PERCENTILES){
+            output << ",\"" << GetPercentileName(percentile) << "\":" << histogram.GetValueAtPercentile(percentile);
+        }
+        output << '}';
+        is_first = false;
+    }
+    output << "}}";
+}
+
+//=================================================================================
+MetricCounter &MetricsRegistry::GetCounter(std::string_view name)
+{
+    std::lock_guard guard(mutex_);
+    auto iter = counters_.find(name);
+    if (iter == counters_.end()){
+        iter = counters_.emplace(std::string(name), std::make_unique<MetricCounter>()).first;
+    }
+    return *iter->second;
+}
+
+//=================================================================================
+LatencyHistogram &MetricsRegistry::GetHistogram(std::string_view name)
+{
+    std::lock_guard guard(mutex_);
+    auto iter = histograms_.find(name);
+    if (iter == histograms_.end()){
+        iter = histograms_.emplace(std::string(name), std::make_unique<LatencyHistogram>()).first;
+    }
+    return *iter->second;
+}
+
+//=================================================================================
+MetricsSnapshot MetricsRegistry::GetSnapshot() const
+{
+    std::lock_guard guard(mutex_);
+    MetricsSnapshot snapshot;
+    for (const auto& [name, counter] : counters_){
+        snapshot.counters.emplace(name, counter->Get());
+    }
+    for (const auto& [name, histogram] : histograms_){
+        snapshot.histograms.emplace(name, histogram->GetSnapshot());
+    }
+    return snapshot;
+}
+
+//=================================================================================
+void MetricsRegistry::Reset()
+{
+    std::lock_guard guard(mutex_);
+    for (auto& [name, counter] : counters_){
+        counter->Reset();
+    }
+    for (auto& [name, histogram] : histograms_){
+        histogram->Reset();
+    }
+}
+
+//=================================================================================
+MetricsRegistry &MetricsRegistry::GetDefault()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
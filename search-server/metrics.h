@@ -0,0 +1,187 @@
+#pragma once
+
+//=================================================================================
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//=================================================================================
+#include "log_duration.h"
+
+//=================================================================================
+// Timer of the enclosing scope, recorded into the histogram of the registry with this name. No I/O on the way:
+// the histogram is looked up once per call site, and the timer costs two clock reads and two atomic additions.
+// Defining SEARCH_SERVER_NO_METRICS compiles the timers out
+#ifdef SEARCH_SERVER_NO_METRICS
+#define METRIC_DURATION(name)
+#else
+#define METRIC_DURATION(name) \
+    static LatencyHistogram& PROFILE_CONCAT(metricHistogram, __LINE__) = MetricsRegistry::GetDefault().GetHistogram(name); \
+    ScopedTimer PROFILE_CONCAT(metricTimer, __LINE__)(PROFILE_CONCAT(metricHistogram, __LINE__))
+#endif
+
+//=================================================================================
+namespace metrics_detail {
+
+// Metrics are updated in shards, one per thread while there are no more threads than shards,
+// so threads do not contend for cache lines. Reading a metric merges its shards
+inline constexpr size_t SHARD_COUNT = 16;
+
+size_t GetCurrentThreadShard();
+
+}
+
+//=================================================================================
+class MetricCounter {
+public:
+    void Add(uint64_t value = 1);
+    uint64_t Get() const;
+    void Reset();
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, metrics_detail::SHARD_COUNT> shards_;
+};
+
+//=================================================================================
+struct HistogramSnapshot {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    std::vector<uint64_t> bucket_counts;
+
+    double GetMean() const;
+    // Highest value of the bucket the percentile falls into, within the precision of the buckets
+    uint64_t GetValueAtPercentile(double percentile) const;
+};
+
+//=================================================================================
+// Log-linear histogram of values (nanoseconds for latencies), as in HDR histograms: every power of two is split
+// into SUB_BUCKET_COUNT buckets of equal width, so a value is kept with a relative error under 1 / SUB_BUCKET_COUNT.
+// Values from 2^(MAX_EXPONENT + 1) on (about 37 minutes in nanoseconds) go into the last bucket, along with its own sub-bucket
+class LatencyHistogram {
+public:
+    inline static constexpr int SUB_BUCKET_BITS = 4;
+    inline static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t{1} << SUB_BUCKET_BITS;
+    inline static constexpr int MAX_EXPONENT = 40;
+    inline static constexpr size_t BUCKET_COUNT = SUB_BUCKET_COUNT * (MAX_EXPONENT - SUB_BUCKET_BITS + 2);
+
+    LatencyHistogram();
+
+    void Record(uint64_t value);
+    HistogramSnapshot GetSnapshot() const;
+    void Reset();
+
+    static size_t GetBucketIndex(uint64_t value);
+    static uint64_t GetBucketLowerBound(size_t bucket_index);
+    static uint64_t GetBucketUpperBound(size_t bucket_index);
+
+private:
+    struct Shard {
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> bucket_counts{};
+        alignas(64) std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+};
+
+//=================================================================================
+class ScopedTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ScopedTimer(LatencyHistogram& histogram);
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    LatencyHistogram& histogram_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+//=================================================================================
+struct MetricsSnapshot {
+    std::map<std::string, uint64_t> counters;
+    std::map<std::string, HistogramSnapshot> histograms;
+
+    // One line per metric, histograms with their count, mean, max and p50/p90/p99/p999
+    void PrintText(std::ostream& output) const;
+    void PrintJson(std::ostream& output) const;
+};
+
+//=================================================================================
+// Named counters and histograms. A metric is created by the first lookup of its name and lives as long as the
+// registry, so the references may be kept; lookups take a lock, updates do not
+class MetricsRegistry {
+public:
+    MetricCounter& GetCounter(std::string_view name);
+    LatencyHistogram& GetHistogram(std::string_view name);
+
+    MetricsSnapshot GetSnapshot() const;
+    // Zeroes every metric, updates running at the same time may be kept or lost
+    void Reset();
+
+    // Registry of the instrumented operations of the search server
+    static MetricsRegistry& GetDefault();
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<MetricCounter>, std::less<>> counters_;
+    std::map<std::string, std::unique_ptr<LatencyHistogram>, std::less<>> histograms_;
+};
+
+//=================================================================================
+inline void MetricCounter::Add(uint64_t value)
+{
+    shards_[metrics_detail::GetCurrentThreadShard()].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+//=================================================================================
+inline size_t LatencyHistogram::GetBucketIndex(uint64_t value)
+{
+    if (value < SUB_BUCKET_COUNT){
+        return value;
+    }
+    const int exponent = 63 - __builtin_clzll(value);
+    if (exponent > MAX_EXPONENT){
+        return BUCKET_COUNT - 1;
+    }
+    // The top SUB_BUCKET_BITS + 1 bits of the value: the leading one and the sub-bucket
+    const int shift = exponent - SUB_BUCKET_BITS;
+    return SUB_BUCKET_COUNT * (shift + 1) + ((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+//=================================================================================
+inline void LatencyHistogram::Record(uint64_t value)
+{
+    Shard& shard = shards_[metrics_detail::GetCurrentThreadShard()];
+    shard.bucket_counts[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+    // Threads sharing a shard rarely race here, a lost maximum is corrected by the next greater value
+    if (value > shard.max.load(std::memory_order_relaxed)){
+        shard.max.store(value, std::memory_order_relaxed);
+    }
+}
+
+//=================================================================================
+inline ScopedTimer::ScopedTimer(LatencyHistogram &histogram) : histogram_(histogram) {}
+
+//=================================================================================
+inline ScopedTimer::~ScopedTimer()
+{
+    histogram_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_).count());
+}
@@ -0,0 +1,382 @@
+#include "posting_list.h"
+
+//=================================================================================
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define POSTING_LIST_SSE2
+#include <emmintrin.h>
+#endif
+
+//=================================================================================
+#include "index_snapshot.h"
+
+//=================================================================================
+namespace {
+
+// Values of a block are packed in 4 interleaved lanes: value i goes to lane i % 4, and every lane packs its
+// 32 values into `bits` words of its own. Word j of lane k is stored at 4 * j + k, so one 128-bit load
+// brings the same word of all lanes and a row of 4 consecutive values is unpacked at once
+inline constexpr size_t PACK_LANE_COUNT = 4;
+inline constexpr size_t PACK_ROW_COUNT = POSTING_BLOCK_SIZE / PACK_LANE_COUNT;
+
+uint32_t GetBitWidth(uint32_t value)
+{
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+//=================================================================================
+void PackValues(const uint32_t* values, uint32_t bits, uint32_t* out)
+{
+    for (size_t lane = 0; lane < PACK_LANE_COUNT && bits > 0; ++lane){
+        uint64_t buffer = 0;
+        uint32_t buffered_bits = 0;
+        size_t word = 0;
+        for (size_t row = 0; row < PACK_ROW_COUNT; ++row){
+            buffer |= static_cast<uint64_t>(values[row * PACK_LANE_COUNT + lane]) << buffered_bits;
+            buffered_bits += bits;
+            if (buffered_bits >= 32){
+                out[word++ * PACK_LANE_COUNT + lane] = static_cast<uint32_t>(buffer);
+                buffer >>= 32;
+                buffered_bits -= 32;
+            }
+        }
+    }
+}
+
+//=================================================================================
+#ifdef POSTING_LIST_SSE2
+// Row RowIndex of values with Bits bits each; positions are known at compile time, so the shifts are immediate
+template <uint32_t Bits, size_t RowIndex>
+inline __m128i UnpackRow(const uint32_t* in)
+{
+    if constexpr (Bits == 0){
+        return _mm_setzero_si128();
+    } else {
+        constexpr uint32_t first_bit = RowIndex * Bits;
+        constexpr uint32_t word = first_bit / 32;
+        constexpr uint32_t shift = first_bit % 32;
+        const __m128i* words = reinterpret_cast<const __m128i*>(in) + word;
+        __m128i values = _mm_srli_epi32(_mm_loadu_si128(words), shift);
+        if constexpr (shift + Bits > 32){
+            values = _mm_or_si128(values, _mm_slli_epi32(_mm_loadu_si128(words + 1), 32 - shift));
+        }
+        if constexpr (Bits < 32){
+            values = _mm_and_si128(values, _mm_set1_epi32(static_cast<int>((1u << Bits) - 1)));
+        }
+        return values;
+    }
+}
+
+//=================================================================================
+template <uint32_t Bits, size_t... RowIndexes>
+inline void DecodeOrdinalRows(const uint32_t* in, int previous, int* ordinals, std::index_sequence<RowIndexes...>)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i base = _mm_set1_epi32(previous);
+    // Prefix sum of every row plus the last ordinal of the previous row
+    const auto decode_row = [&](size_t row, __m128i deltas){
+        __m128i values = _mm_add_epi32(deltas, one);
+        values = _mm_add_epi32(values, _mm_slli_si128(values, 4));
+        values = _mm_add_epi32(values, _mm_slli_si128(values, 8));
+        values = _mm_add_epi32(values, base);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ordinals + row * PACK_LANE_COUNT), values);
+        base = _mm_shuffle_epi32(values, _MM_SHUFFLE(3, 3, 3, 3));
+    };
+    (decode_row(RowIndexes, UnpackRow<Bits, RowIndexes>(in)), ...);
+}
+
+//=================================================================================
+template <uint32_t Bits, size_t... RowIndexes>
+inline void DecodeCountRows(const uint32_t* in, uint32_t* counts, std::index_sequence<RowIndexes...>)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    (_mm_storeu_si128(reinterpret_cast<__m128i*>(counts + RowIndexes * PACK_LANE_COUNT),
+                      _mm_add_epi32(UnpackRow<Bits, RowIndexes>(in), one)), ...);
+}
+
+//=================================================================================
+using OrdinalDecoder = void (*)(const uint32_t*, int, int*);
+using CountDecoder = void (*)(const uint32_t*, uint32_t*);
+
+template <size_t... Bits>
+constexpr std::array<OrdinalDecoder, sizeof...(Bits)> MakeOrdinalDecoders(std::index_sequence<Bits...>)
+{
+    return {[](const uint32_t* in, int previous, int* ordinals){
+        DecodeOrdinalRows<Bits>(in, previous, ordinals, std::make_index_sequence<PACK_ROW_COUNT>());
+    }...};
+}
+
+template <size_t... Bits>
+constexpr std::array<CountDecoder, sizeof...(Bits)> MakeCountDecoders(std::index_sequence<Bits...>)
+{
+    return {[](const uint32_t* in, uint32_t* counts){
+        DecodeCountRows<Bits>(in, counts, std::make_index_sequence<PACK_ROW_COUNT>());
+    }...};
+}
+
+// A decoder per bit width from 0 to 32
+constexpr auto ORDINAL_DECODERS = MakeOrdinalDecoders(std::make_index_sequence<33>());
+constexpr auto COUNT_DECODERS = MakeCountDecoders(std::make_index_sequence<33>());
+
+//=================================================================================
+void DecodeOrdinals(const uint32_t* in, uint32_t bits, int previous, int* ordinals)
+{
+    ORDINAL_DECODERS[bits](in, previous, ordinals);
+}
+
+//=================================================================================
+void DecodeCounts(const uint32_t* in, uint32_t bits, uint32_t* counts)
+{
+    COUNT_DECODERS[bits](in, counts);
+}
+
+//=================================================================================
+#else
+void UnpackValues(const uint32_t* in, uint32_t bits, uint32_t* values)
+{
+    const uint64_t mask = (uint64_t{1} << bits) - 1;
+    for (size_t lane = 0; lane < PACK_LANE_COUNT; ++lane){
+        uint64_t buffer = 0;
+        uint32_t buffered_bits = 0;
+        size_t word = 0;
+        for (size_t row = 0; row < PACK_ROW_COUNT; ++row){
+            if (buffered_bits < bits){
+                buffer |= static_cast<uint64_t>(in[word++ * PACK_LANE_COUNT + lane]) << buffered_bits;
+                buffered_bits += 32;
+            }
+            values[row * PACK_LANE_COUNT + lane] = static_cast<uint32_t>(buffer & mask);
+            buffer >>= bits;
+            buffered_bits -= bits;
+        }
+    }
+}
+
+//=================================================================================
+void DecodeOrdinals(const uint32_t* in, uint32_t bits, int previous, int* ordinals)
+{
+    std::array<uint32_t, POSTING_BLOCK_SIZE> deltas;
+    UnpackValues(in, bits, deltas.data());
+    for (size_t i = 0; i < POSTING_BLOCK_SIZE; ++i){
+        previous = static_cast<int>(static_cast<uint32_t>(previous) + deltas[i] + 1);
+        ordinals[i] = previous;
+    }
+}
+
+//=================================================================================
+void DecodeCounts(const uint32_t* in, uint32_t bits, uint32_t* counts)
+{
+    UnpackValues(in, bits, counts);
+    for (size_t i = 0; i < POSTING_BLOCK_SIZE; ++i){
+        ++counts[i];
+    }
+}
+#endif
+
+}
+
+//=================================================================================
+void PostingList::Append(int ordinal, uint32_t count, double term_freq)
+{
+    if (tail_ordinals_.size() == POSTING_BLOCK_SIZE){
+        PackTail();
+    }
+    tail_ordinals_.push_back(ordinal);
+    tail_counts_.push_back(count);
+    tail_max_term_freq_ = std::max(tail_max_term_freq_, term_freq);
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+}
+
+//=================================================================================
+void PostingList::Compact(const std::vector<bool> &removed_ordinals, const std::vector<double> &inv_word_counts)
+{
+    PostingList compacted;
+    std::array<int, POSTING_BLOCK_SIZE> ordinals;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> counts;
+    for (size_t block = 0; block < GetBlockCount(); ++block){
+        const size_t count = DecodeBlock(block, ordinals.data(), counts.data());
+        for (size_t i = 0; i < count; ++i){
+            if (!removed_ordinals[ordinals[i]]){
+                compacted.Append(ordinals[i], counts[i], ComputeTermFreq(counts[i], inv_word_counts[ordinals[i]]));
+            }
+        }
+    }
+    *this = std::move(compacted);
+}
+
+//=================================================================================
+void PostingList::Renumber(const std::vector<int> &new_ordinals, const std::vector<double> &inv_word_counts)
+{
+    PostingList renumbered;
+    std::array<int, POSTING_BLOCK_SIZE> ordinals;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> counts;
+    for (size_t block = 0; block < GetBlockCount(); ++block){
+        const size_t count = DecodeBlock(block, ordinals.data(), counts.data());
+        for (size_t i = 0; i < count; ++i){
+            const int ordinal = new_ordinals[ordinals[i]];
+            if (ordinal >= 0){
+                renumbered.Append(ordinal, counts[i], ComputeTermFreq(counts[i], inv_word_counts[ordinal]));
+            }
+        }
+    }
+    *this = std::move(renumbered);
+}
+
+//=================================================================================
+size_t PostingList::FindBlock(int ordinal, size_t first_block) const
+{
+    // Galloping over the skip headers of the packed blocks
+    size_t low = first_block;
+    size_t step = 1;
+    while (low + step <= blocks_.size() && blocks_[low + step - 1].last_ordinal < ordinal){
+        low += step;
+        step *= 2;
+    }
+    const auto header = std::partition_point(blocks_.begin() + std::min(low, blocks_.size()),
+                                             blocks_.begin() + std::min(low + step, blocks_.size()),
+                                             [ordinal](const BlockHeader& header){ return header.last_ordinal < ordinal; });
+    if (header != blocks_.end()){
+        return header - blocks_.begin();
+    }
+    const bool is_in_tail = first_block <= blocks_.size() && !tail_ordinals_.empty() && tail_ordinals_.back() >= ordinal;
+    return is_in_tail ? blocks_.size() : GetBlockCount();
+}
+
+//=================================================================================
+size_t PostingList::DecodeBlock(size_t block, int *ordinals, uint32_t *counts) const
+{
+    if (block == blocks_.size()){
+        std::copy(tail_ordinals_.begin(), tail_ordinals_.end(), ordinals);
+        if (counts != nullptr){
+            std::copy(tail_counts_.begin(), tail_counts_.end(), counts);
+        }
+        return tail_ordinals_.size();
+    }
+
+    const BlockHeader& header = blocks_[block];
+    const uint32_t* data = packed_.data() + header.offset;
+    DecodeOrdinals(data, header.ordinal_bits, block == 0 ? -1 : blocks_[block - 1].last_ordinal, ordinals);
+    if (counts != nullptr){
+        DecodeCounts(data + PACK_LANE_COUNT * header.ordinal_bits, header.count_bits, counts);
+    }
+    return POSTING_BLOCK_SIZE;
+}
+
+//=================================================================================
+void PostingList::PackTail()
+{
+    // Ordinals are strictly increasing and counts positive, so both are stored minus one
+    std::array<uint32_t, POSTING_BLOCK_SIZE> deltas;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> counts;
+    int previous = blocks_.empty() ? -1 : blocks_.back().last_ordinal;
+    uint32_t delta_bits = 0;
+    uint32_t count_bits = 0;
+    for (size_t i = 0; i < POSTING_BLOCK_SIZE; ++i){
+        deltas[i] = static_cast<uint32_t>(tail_ordinals_[i] - previous - 1);
+        counts[i] = tail_counts_[i] - 1;
+        previous = tail_ordinals_[i];
+        delta_bits |= deltas[i];
+        count_bits |= counts[i];
+    }
+
+    const BlockHeader header{
+        previous,
+        static_cast<uint32_t>(packed_.size()),
+        static_cast<uint8_t>(GetBitWidth(delta_bits)),
+        static_cast<uint8_t>(GetBitWidth(count_bits)),
+        tail_max_term_freq_
+    };
+    packed_.resize(packed_.size() + PACK_LANE_COUNT * (header.ordinal_bits + header.count_bits));
+    PackValues(deltas.data(), header.ordinal_bits, packed_.data() + header.offset);
+    PackValues(counts.data(), header.count_bits, packed_.data() + header.offset + PACK_LANE_COUNT * header.ordinal_bits);
+    blocks_.push_back(header);
+
+    tail_ordinals_.clear();
+    tail_counts_.clear();
+    tail_max_term_freq_ = 0.;
+}
+
+//=================================================================================
+void PostingList::Save(SnapshotWriter &writer) const
+{
+    // Block headers are stored by field, so each field is one array in the file
+    writer.Write<uint64_t>(blocks_.size());
+    writer.Write<double>(max_term_freq_);
+    for (const BlockHeader& header : blocks_){
+        writer.Write<int32_t>(header.last_ordinal);
+    }
+    for (const BlockHeader& header : blocks_){
+        writer.Write<double>(header.max_term_freq);
+    }
+    for (const BlockHeader& header : blocks_){
+        writer.Write<uint8_t>(header.ordinal_bits);
+    }
+    for (const BlockHeader& header : blocks_){
+        writer.Write<uint8_t>(header.count_bits);
+    }
+    writer.Write<uint64_t>(packed_.size());
+    writer.WriteArray(packed_.data(), packed_.size());
+
+    writer.Write<uint64_t>(tail_ordinals_.size());
+    writer.WriteArray(tail_ordinals_.data(), tail_ordinals_.size());
+    writer.WriteArray(tail_counts_.data(), tail_counts_.size());
+    writer.Write<double>(tail_max_term_freq_);
+}
+
+//=================================================================================
+void PostingList::Load(SnapshotReader &reader)
+{
+    const auto check = [](bool condition){
+        if (!condition){
+            throw std::runtime_error("snapshot is corrupted");
+        }
+    };
+
+    const uint64_t block_count = reader.Read<uint64_t>();
+    check(block_count <= static_cast<uint64_t>(std::numeric_limits<int>::max()) / POSTING_BLOCK_SIZE);
+    max_term_freq_ = reader.Read<double>();
+    const char* last_ordinals = reader.ReadBytes(block_count * sizeof(int32_t));
+    const char* max_term_freqs = reader.ReadBytes(block_count * sizeof(double));
+    const char* ordinal_bits = reader.ReadBytes(block_count * sizeof(uint8_t));
+    const char* count_bits = reader.ReadBytes(block_count * sizeof(uint8_t));
+
+    // A block holds POSTING_BLOCK_SIZE increasing ordinals, so its last ordinal is at least that much past the
+    // previous one. The packed deltas and counts are not decoded: the snapshot checksum covers them
+    blocks_.resize(block_count);
+    uint64_t packed_size = 0;
+    int64_t previous_last_ordinal = -1;
+    for (uint64_t block = 0; block < block_count; ++block){
+        BlockHeader& header = blocks_[block];
+        std::memcpy(&header.last_ordinal, last_ordinals + block * sizeof(int32_t), sizeof(int32_t));
+        std::memcpy(&header.max_term_freq, max_term_freqs + block * sizeof(double), sizeof(double));
+        header.ordinal_bits = static_cast<uint8_t>(ordinal_bits[block]);
+        header.count_bits = static_cast<uint8_t>(count_bits[block]);
+        header.offset = static_cast<uint32_t>(packed_size);
+        check(header.last_ordinal - previous_last_ordinal >= static_cast<int64_t>(POSTING_BLOCK_SIZE)
+              && header.ordinal_bits <= 32 && header.count_bits <= 32 && header.max_term_freq <= max_term_freq_);
+        previous_last_ordinal = header.last_ordinal;
+        packed_size += PACK_LANE_COUNT * (header.ordinal_bits + header.count_bits);
+        check(packed_size <= std::numeric_limits<uint32_t>::max());
+    }
+    check(reader.Read<uint64_t>() == packed_size);
+    packed_.resize(packed_size);
+    reader.ReadArray(packed_.data(), packed_.size());
+
+    const uint64_t tail_size = reader.Read<uint64_t>();
+    check(tail_size <= POSTING_BLOCK_SIZE);
+    tail_ordinals_.resize(tail_size);
+    tail_counts_.resize(tail_size);
+    reader.ReadArray(tail_ordinals_.data(), tail_ordinals_.size());
+    reader.ReadArray(tail_counts_.data(), tail_counts_.size());
+    tail_max_term_freq_ = reader.Read<double>();
+    check(tail_max_term_freq_ <= max_term_freq_);
+    for (size_t i = 0; i < tail_size; ++i){
+        check(tail_ordinals_[i] > previous_last_ordinal && tail_counts_[i] > 0);
+        previous_last_ordinal = tail_ordinals_[i];
+    }
+}
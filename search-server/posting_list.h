@@ -0,0 +1,112 @@
+#pragma once
+
+//=================================================================================
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//=================================================================================
+class SnapshotWriter;
+class SnapshotReader;
+
+//=================================================================================
+inline constexpr size_t POSTING_BLOCK_SIZE = 128;
+
+//=================================================================================
+// Frequency of a term occurring count times in a document with inv_word_count = 1 / (number of its words).
+// The index computes every term frequency here, so postings store only the count
+inline double ComputeTermFreq(uint32_t count, double inv_word_count)
+{
+    return count * inv_word_count;
+}
+
+//=================================================================================
+// Postings of a single term sorted by document ordinal: the ordinal and the number of occurrences of the term.
+// Full blocks of POSTING_BLOCK_SIZE postings are bit-packed: ordinal deltas and counts take the width of the
+// largest value in the block. Every block has a skip header with its last ordinal and largest term frequency.
+// The last, incomplete block (the tail) is kept unpacked, so postings of new documents are appended cheaply.
+// Postings of removed documents stay until the list is compacted.
+class PostingList {
+public:
+    // Appends a posting with an ordinal greater than all others
+    void Append(int ordinal, uint32_t count, double term_freq);
+    // Drops the postings of removed ordinals and repacks the rest
+    void Compact(const std::vector<bool>& removed_ordinals, const std::vector<double>& inv_word_counts);
+    // Moves every posting to new_ordinals[ordinal] and drops those mapped to a negative one. The mapping keeps
+    // the order of ordinals, inv_word_counts are indexed by the new ones
+    void Renumber(const std::vector<int>& new_ordinals, const std::vector<double>& inv_word_counts);
+
+    size_t size() const;
+    bool empty() const;
+    // Bound of the term frequencies for dynamic pruning
+    double GetMaxTermFreq() const;
+
+    // Blocks by increasing ordinals, the tail is the last one
+    size_t GetBlockCount() const;
+    int GetBlockLastOrdinal(size_t block) const;
+    double GetBlockMaxTermFreq(size_t block) const;
+    // First block, not before first_block, whose last ordinal is not less than the given one; GetBlockCount() if none
+    size_t FindBlock(int ordinal, size_t first_block = 0) const;
+
+    // Decodes the postings of a block into arrays of POSTING_BLOCK_SIZE and returns their number; counts may be nullptr
+    size_t DecodeBlock(size_t block, int* ordinals, uint32_t* counts) const;
+
+    void Save(SnapshotWriter& writer) const;
+    // Throws std::runtime_error if the block headers or the tail are inconsistent.
+    // Packed blocks are copied as they are, without decoding
+    void Load(SnapshotReader& reader);
+
+private:
+    struct BlockHeader {
+        int last_ordinal;
+        uint32_t offset;            // of the packed deltas in packed_, the packed counts follow them
+        uint8_t ordinal_bits;
+        uint8_t count_bits;
+        double max_term_freq;
+    };
+
+    std::vector<BlockHeader> blocks_;
+    std::vector<uint32_t> packed_;
+    std::vector<int> tail_ordinals_;
+    std::vector<uint32_t> tail_counts_;
+    double tail_max_term_freq_ = 0.;
+    double max_term_freq_ = 0.;
+
+    void PackTail();
+};
+
+//=================================================================================
+inline size_t PostingList::size() const
+{
+    return blocks_.size() * POSTING_BLOCK_SIZE + tail_ordinals_.size();
+}
+
+//=================================================================================
+inline bool PostingList::empty() const
+{
+    return size() == 0;
+}
+
+//=================================================================================
+inline double PostingList::GetMaxTermFreq() const
+{
+    return max_term_freq_;
+}
+
+//=================================================================================
+inline size_t PostingList::GetBlockCount() const
+{
+    return blocks_.size() + (tail_ordinals_.empty() ? 0 : 1);
+}
+
+//=================================================================================
+inline int PostingList::GetBlockLastOrdinal(size_t block) const
+{
+    return block < blocks_.size() ? blocks_[block].last_ordinal : tail_ordinals_.back();
+}
+
+//=================================================================================
+inline double PostingList::GetBlockMaxTermFreq(size_t block) const
+{
+    return block < blocks_.size() ? blocks_[block].max_term_freq : tail_max_term_freq_;
+}
@@ -1,24 +1,81 @@
 #include "process_queries.h"
 
-#include <execution>
-#include <numeric>
 #include <utility>
 
+#include "batch_query_executor.h"
+
+void JoinedDocuments::Append(const std::vector<Document> &documents)
+{
+    documents_.insert(documents_.end(), documents.begin(), documents.end());
+    offsets_.push_back(documents_.size());
+}
+
+void JoinedDocuments::Reserve(size_t query_count)
+{
+    offsets_.reserve(query_count + 1);
+    documents_.reserve(query_count * MAX_RESULT_DOCUMENT_COUNT);
+}
+
+size_t JoinedDocuments::GetQueryCount() const
+{
+    return offsets_.size() - 1;
+}
+
+IteratorRange<JoinedDocuments::const_iterator> JoinedDocuments::GetQueryDocuments(size_t query_index) const
+{
+    return {documents_.begin() + offsets_.at(query_index), documents_.begin() + offsets_.at(query_index + 1)};
+}
+
+const std::vector<Document> &JoinedDocuments::GetDocuments() const
+{
+    return documents_;
+}
+
+const std::vector<size_t> &JoinedDocuments::GetOffsets() const
+{
+    return offsets_;
+}
+
+JoinedDocuments::const_iterator JoinedDocuments::begin() const
+{
+    return documents_.begin();
+}
+
+JoinedDocuments::const_iterator JoinedDocuments::end() const
+{
+    return documents_.end();
+}
+
+size_t JoinedDocuments::size() const
+{
+    return documents_.size();
+}
+
+bool JoinedDocuments::empty() const
+{
+    return documents_.empty();
+}
+
 std::vector<std::vector<Document>> ProcessQueries(const SearchServer &search_server, const std::vector<std::string> &queries)
 {
-    std::vector<std::vector<Document>>documents_lists(queries.size());
-    std::transform(std::execution::par, queries.begin(), queries.end(), documents_lists.begin(), [&search_server](const std::string& query){
-        return search_server.FindTopDocuments(query);
+    return BatchQueryExecutor::GetDefault().ProcessQueries(search_server, queries);
+}
+
+JoinedDocuments ProcessQueriesJoined(const SearchServer &search_server, const std::vector<std::string> &queries)
+{
+    JoinedDocuments joined;
+    joined.Reserve(queries.size());
+    // Results arrive in the order of the queries, so they are appended as they come
+    ProcessQueriesJoined(search_server, queries, [&joined](size_t, const std::vector<Document>& documents){
+        joined.Append(documents);
     });
-    return documents_lists;
+    return joined;
 }
 
-std::list<Document> ProcessQueriesJoined(const SearchServer &search_server, const std::vector<std::string> &queries)
+void ProcessQueriesJoined(const SearchServer &search_server, const std::vector<std::string> &queries,
+                          const std::function<void (size_t, const std::vector<Document> &)> &consumer)
 {
-    std::list<Document> docs;
-    for (auto &ds : ProcessQueries(search_server, queries)){
-        for (auto &d : ds)
-            docs.push_back(std::move(d));
-    }
-    return docs;
+    BatchQueryExecutor::GetDefault().ProcessQueries(search_server, queries, [&consumer](size_t query_index, std::vector<Document>&& documents){
+        consumer(query_index, documents);
+    });
 }
@@ -4,16 +4,49 @@
 #define PROCESS_QUERIES_H
 
 #include <stdlib.h>
+#include <functional>
 #include <vector>
-#include <list>
+#include "paginator.h"
 #include "search_server.h"
 
+// Results of a batch of queries in one buffer, query after query.
+// The documents of query i are [offsets[i], offsets[i + 1]), iteration goes over all of them
+class JoinedDocuments {
+public:
+    using const_iterator = std::vector<Document>::const_iterator;
+
+    // Appends the documents of the next query
+    void Append(const std::vector<Document>& documents);
+    void Reserve(size_t query_count);
+
+    size_t GetQueryCount() const;
+    IteratorRange<const_iterator> GetQueryDocuments(size_t query_index) const;
+    const std::vector<Document>& GetDocuments() const;
+    const std::vector<size_t>& GetOffsets() const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_{0};
+};
+
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+JoinedDocuments ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
+// Passes the documents of every query to consumer in the order of the queries as soon as they are ready,
+// while the rest of the batch is still running. The consumer is not called concurrently
+void ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    const std::function<void(size_t query_index, const std::vector<Document>& documents)>& consumer);
+
 #endif // PROCESS_QUERIES_H
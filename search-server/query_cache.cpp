@@ -0,0 +1,104 @@
+#include "query_cache.h"
+
+//=================================================================================
+#include <algorithm>
+#include <functional>
+
+//=================================================================================
+QueryResultCache::QueryResultCache(size_t capacity, size_t shard_count)
+    : shards_(std::max<size_t>(1, std::min(capacity, shard_count)))
+{
+    // The first shards take one entry of the remainder each
+    for (size_t i = 0; i < shards_.size(); ++i){
+        shards_[i].capacity = capacity / shards_.size() + (i < capacity % shards_.size() ? 1 : 0);
+    }
+}
+
+//=================================================================================
+std::string QueryResultCache::MakeKey(const std::vector<std::string_view> &plus_words,
+                                      const std::vector<std::string_view> &minus_words,
+                                      DocumentStatus status, size_t max_result_document_count)
+{
+    // Words contain neither spaces nor control characters, so these separators are unambiguous
+    std::string key;
+    for (const std::string_view word : plus_words){
+        key.append(word).push_back(' ');
+    }
+    key.push_back('\n');
+    for (const std::string_view word : minus_words){
+        key.append(word).push_back(' ');
+    }
+    key.push_back('\n');
+    key.append(std::to_string(static_cast<int>(status))).push_back('\n');
+    key.append(std::to_string(max_result_document_count));
+    return key;
+}
+
+//=================================================================================
+std::optional<std::vector<Document>> QueryResultCache::Find(const std::string &key, uint64_t epoch)
+{
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+
+    const auto iter = shard.index.find(key);
+    if (iter == shard.index.end()){
+        ++misses_;
+        return std::nullopt;
+    }
+    if (iter->second->epoch != epoch){
+        shard.entries.erase(iter->second);
+        shard.index.erase(iter);
+        ++misses_;
+        return std::nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, iter->second);
+    ++hits_;
+    return shard.entries.front().documents;
+}
+
+//=================================================================================
+void QueryResultCache::Insert(const std::string &key, uint64_t epoch, const std::vector<Document> &documents)
+{
+    Shard& shard = GetShard(key);
+    if (shard.capacity == 0){
+        return;
+    }
+    std::lock_guard guard(shard.mutex);
+
+    const auto iter = shard.index.find(key);
+    if (iter != shard.index.end()){
+        // Another thread may have computed the same query meanwhile
+        iter->second->epoch = epoch;
+        iter->second->documents = documents;
+        shard.entries.splice(shard.entries.begin(), shard.entries, iter->second);
+        return;
+    }
+
+    if (shard.entries.size() == shard.capacity){
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        ++evictions_;
+    }
+    shard.entries.push_front({key, epoch, documents});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+//=================================================================================
+QueryCacheStats QueryResultCache::GetStats() const
+{
+    QueryCacheStats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    for (const Shard& shard : shards_){
+        std::lock_guard guard(shard.mutex);
+        stats.size += shard.entries.size();
+    }
+    return stats;
+}
+
+//=================================================================================
+QueryResultCache::Shard &QueryResultCache::GetShard(const std::string &key)
+{
+    return shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
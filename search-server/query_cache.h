@@ -0,0 +1,65 @@
+#pragma once
+
+//=================================================================================
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+//=================================================================================
+#include "document.h"
+
+//=================================================================================
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;        // including entries found from an older epoch
+    uint64_t evictions = 0;
+    size_t size = 0;
+};
+
+//=================================================================================
+// Bounded LRU cache of search results, split into shards with a mutex each.
+// Every entry remembers the index epoch it was computed at, and a lookup with another epoch misses.
+// The capacity is split between the shards exactly, each shard evicts on its own. A cache smaller than
+// the shard count takes as many shards as it holds entries, so that every shard holds one at least
+class QueryResultCache {
+public:
+    explicit QueryResultCache(size_t capacity, size_t shard_count = 16);
+
+    // Key of a normalized query: sorted distinct plus and minus words without stop words
+    static std::string MakeKey(const std::vector<std::string_view>& plus_words,
+                               const std::vector<std::string_view>& minus_words,
+                               DocumentStatus status, size_t max_result_document_count);
+
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t epoch);
+    void Insert(const std::string& key, uint64_t epoch, const std::vector<Document>& documents);
+
+    QueryCacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t epoch;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        size_t capacity = 0;
+        mutable std::mutex mutex;
+        std::list<Entry> entries;       // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    };
+
+    std::vector<Shard> shards_;
+
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+    std::atomic<uint64_t> evictions_ = 0;
+
+    Shard& GetShard(const std::string& key);
+};
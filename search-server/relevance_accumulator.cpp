@@ -0,0 +1,22 @@
+#include "relevance_accumulator.h"
+
+//=================================================================================
+#include <algorithm>
+
+//=================================================================================
+void RelevanceAccumulator::Reset(size_t ordinal_count, const DocumentFilter& filter)
+{
+    filter_ = filter;
+    if (relevances_.size() < ordinal_count){
+        relevances_.resize(ordinal_count);
+        scored_generations_.resize(ordinal_count, 0);
+    }
+    scored_ordinals_.clear();
+
+    ++generation_;
+    if (generation_ == 0){
+        // The stamp has wrapped around: old stamps may collide with the new generations
+        std::fill(scored_generations_.begin(), scored_generations_.end(), 0);
+        generation_ = 1;
+    }
+}
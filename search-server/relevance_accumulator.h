@@ -0,0 +1,73 @@
+#pragma once
+
+//=================================================================================
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//=================================================================================
+#include "search_filter.h"
+
+//=================================================================================
+// Flat per-document relevance sums indexed by document ordinal.
+// Entries are invalidated by bumping a generation stamp, so Reset does not touch the arrays
+// and the accumulator can be reused across queries without allocations.
+class RelevanceAccumulator {
+public:
+    // Prepares the accumulator for a new query over ordinals [0, ordinal_count).
+    // Documents the filter does not accept are skipped by Add until the next Reset, the bitmaps must outlive it
+    void Reset(size_t ordinal_count, const DocumentFilter& filter = {});
+
+    void Add(int ordinal, double relevance);
+    // Sum of a scored document
+    double GetRelevance(int ordinal) const;
+
+    // Calls function(ordinal, relevance) for every scored document,
+    // starting from the first_scored-th document scored since Reset
+    template <typename Function>
+    void ForEach(Function function, size_t first_scored = 0) const;
+    size_t GetScoredCount() const;
+
+private:
+    std::vector<double> relevances_;
+    std::vector<uint32_t> scored_generations_;
+    std::vector<int> scored_ordinals_;
+    uint32_t generation_ = 0;
+    DocumentFilter filter_;
+};
+
+//=================================================================================
+inline void RelevanceAccumulator::Add(int ordinal, double relevance)
+{
+    if (!filter_.Accepts(ordinal)){
+        return;
+    }
+    if (scored_generations_[ordinal] != generation_){
+        scored_generations_[ordinal] = generation_;
+        relevances_[ordinal] = 0.;
+        scored_ordinals_.push_back(ordinal);
+    }
+    relevances_[ordinal] += relevance;
+}
+
+//=================================================================================
+inline double RelevanceAccumulator::GetRelevance(int ordinal) const
+{
+    return relevances_[ordinal];
+}
+
+//=================================================================================
+template <typename Function>
+void RelevanceAccumulator::ForEach(Function function, size_t first_scored) const
+{
+    for (size_t i = first_scored; i < scored_ordinals_.size(); ++i){
+        const int ordinal = scored_ordinals_[i];
+        function(ordinal, relevances_[ordinal]);
+    }
+}
+
+//=================================================================================
+inline size_t RelevanceAccumulator::GetScoredCount() const
+{
+    return scored_ordinals_.size();
+}
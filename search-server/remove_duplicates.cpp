@@ -3,24 +3,9 @@
 //=================================================================================
 void RemoveDuplicates(SearchServer &search_server)
 {
-    std::set<std::set<std::string>> uniq_words_set;
-    std::set<int> for_removing;
-    for (auto iter = search_server.begin(); iter != search_server.end(); ++iter){
-        const auto& words = search_server.GetWordFrequencies(*iter);
-        std::set<std::string> set;
-        for (const auto& [word, freq] : words){
-            set.insert(std::string(word));
-        }
-
-        if (uniq_words_set.count(set)){
-            for_removing.insert(*iter);
-        } else {
-            uniq_words_set.insert(set);
-        }
-    }
-
-    for (auto iter = for_removing.crbegin(); iter != for_removing.crend(); ++iter){
+    const std::vector<int> duplicate_ids = search_server.FindDuplicateDocuments();
+    for (auto iter = duplicate_ids.crbegin(); iter != duplicate_ids.crend(); ++iter){
         std::cout << "Found duplicate document id " << *iter << std::endl;
-        search_server.RemoveDocument(*iter);
     }
+    search_server.RemoveDocuments(std::execution::par, duplicate_ids);
 }
@@ -1,11 +1,29 @@
 #include "request_queue.h"
 
 //=================================================================================
-RequestQueue::RequestQueue(const SearchServer &search_server) : server(search_server) {}
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+//=================================================================================
+RequestQueue::RequestQueue(const SearchServer &search_server, Clock::duration window, size_t bucket_count,
+                           NowFunction now_function)
+    : server(search_server)
+    , bucket_duration_(bucket_count == 0 ? window : window / static_cast<Clock::rep>(bucket_count))
+    , bucket_count_(bucket_count)
+    , now_function_(now_function ? std::move(now_function) : NowFunction(Clock::now))
+    , start_time_(now_function_())
+{
+    if (bucket_count == 0 || bucket_duration_ <= Clock::duration::zero()){
+        throw std::invalid_argument("request window must split into positive buckets");
+    }
+    buckets_ = std::make_unique<Bucket[]>(bucket_count);
+}
 
 //=================================================================================
 std::vector<Document> RequestQueue::AddFindRequest(const std::string &raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]]int rating) { return document_status == status; });
+    return AddFindRequest(raw_query, SearchFilter(status));
 }
 
 //=================================================================================
@@ -15,5 +33,109 @@ std::vector<Document> RequestQueue::AddFindRequest(const std::string &raw_query)
 
 //=================================================================================
 int RequestQueue::GetNoResultRequests() const {
-    return no_resul_requests_count;
+    return static_cast<int>(GetWindowStats().no_result_request_count);
+}
+
+//=================================================================================
+RequestWindowStats RequestQueue::GetWindowStats() const
+{
+    ExpirePeriodsBefore(GetPeriod(now_function_()) - static_cast<int64_t>(bucket_count_) + 1);
+
+    RequestWindowStats stats;
+    stats.request_count = totals_.request_count.load(std::memory_order_relaxed);
+    stats.no_result_request_count = totals_.no_result_request_count.load(std::memory_order_relaxed);
+    stats.total_latency = std::chrono::nanoseconds(totals_.latency_ns.load(std::memory_order_relaxed));
+    return stats;
+}
+
+//=================================================================================
+int64_t RequestQueue::GetPeriod(Clock::time_point time) const
+{
+    return (time - start_time_) / bucket_duration_;
+}
+
+//=================================================================================
+void RequestQueue::ExpirePeriodsBefore(int64_t period) const
+{
+    int64_t first_period = first_unexpired_period_.load(std::memory_order_acquire);
+    do {
+        if (first_period >= period){
+            return;
+        }
+    } while (!first_unexpired_period_.compare_exchange_weak(first_period, period, std::memory_order_acq_rel));
+
+    // After a pause longer than the window, a single round of the ring expires everything
+    const int64_t bucket_count = static_cast<int64_t>(bucket_count_);
+    for (int64_t expired_period = std::max(first_period, period - bucket_count); expired_period < period; ++expired_period){
+        Bucket& bucket = buckets_[expired_period % bucket_count];
+        int64_t bucket_period = bucket.period.load();
+        while (bucket_period >= 0 && bucket_period < period){
+            if (bucket.period.compare_exchange_weak(bucket_period, RESETTING)){
+                ClearBucket(bucket, true);
+                bucket.period.store(EMPTY);
+                break;
+            }
+        }
+    }
+}
+
+//=================================================================================
+void RequestQueue::ClearBucket(Bucket& bucket, bool is_counted) const
+{
+    while (bucket.writer_count.load() != 0){
+        std::this_thread::yield();
+    }
+
+    const uint64_t request_count = bucket.request_count.exchange(0, std::memory_order_relaxed);
+    const uint64_t no_result_request_count = bucket.no_result_request_count.exchange(0, std::memory_order_relaxed);
+    const int64_t latency_ns = bucket.latency_ns.exchange(0, std::memory_order_relaxed);
+    if (is_counted){
+        totals_.request_count.fetch_sub(request_count, std::memory_order_relaxed);
+        totals_.no_result_request_count.fetch_sub(no_result_request_count, std::memory_order_relaxed);
+        totals_.latency_ns.fetch_sub(latency_ns, std::memory_order_relaxed);
+    }
+}
+
+//=================================================================================
+void RequestQueue::AddRequest(Clock::time_point time, Clock::duration latency, bool is_empty)
+{
+    const int64_t period = GetPeriod(time);
+    if (period < first_unexpired_period_.load(std::memory_order_acquire)){
+        // A request that took longer than the window to be recorded, its period is gone
+        return;
+    }
+    Bucket& bucket = buckets_[period % bucket_count_];
+    const int64_t latency_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+
+    int64_t bucket_period = bucket.period.load();
+    while (true){
+        if (bucket_period == period){
+            // Counting in the bucket and in the totals happens as one writer, so that clearing the bucket
+            // waits for both and subtracts exactly what was added
+            bucket.writer_count.fetch_add(1);
+            if (bucket.period.load() == period){
+                bucket.request_count.fetch_add(1, std::memory_order_relaxed);
+                bucket.no_result_request_count.fetch_add(is_empty, std::memory_order_relaxed);
+                bucket.latency_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+                totals_.request_count.fetch_add(1, std::memory_order_relaxed);
+                totals_.no_result_request_count.fetch_add(is_empty, std::memory_order_relaxed);
+                totals_.latency_ns.fetch_add(latency_ns, std::memory_order_relaxed);
+                bucket.writer_count.fetch_sub(1, std::memory_order_release);
+                return;
+            }
+            bucket.writer_count.fetch_sub(1, std::memory_order_release);
+        } else if (bucket_period > period){
+            // A request that took longer than the window to be recorded, its bucket is gone
+            return;
+        } else if (bucket_period == RESETTING){
+            std::this_thread::yield();
+        } else if (bucket.period.compare_exchange_weak(bucket_period, RESETTING)){
+            // The first request of the period takes out of the totals what the bucket counted a round of the ring ago
+            ClearBucket(bucket, bucket_period != EMPTY);
+            bucket.period.store(period);
+        } else {
+            continue;
+        }
+        bucket_period = bucket.period.load();
+    }
 }
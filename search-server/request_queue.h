@@ -4,23 +4,44 @@
 #include "search_server.h"
 
 //=================================================================================
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
 
 //=================================================================================
+struct RequestWindowStats {
+    uint64_t request_count = 0;
+    uint64_t no_result_request_count = 0;
+    std::chrono::nanoseconds total_latency{0};
+};
+
+//=================================================================================
+// Search requests of the last window of time (a day by default) on the steady clock, safe to share between threads.
+// The window is a ring of buckets, each counting the requests of one period of window / bucket_count with atomics,
+// and running totals count the requests of all the buckets still in the window: a request is added to its bucket
+// and to the totals, and a bucket is subtracted from the totals when it leaves the window, either when the ring comes
+// round to it again or when the statistics are read after its period is over.
+// Reading the statistics takes the totals as they are, after expiring the periods that ended since the last read;
+// they see the window with the precision of one bucket.
+// The time comes from now_function, the steady clock unless another one is given, e.g. a fake clock in tests
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    using Clock = std::chrono::steady_clock;
+    using NowFunction = std::function<Clock::time_point()>;
+
+    explicit RequestQueue(const SearchServer& search_server,
+                          Clock::duration window = std::chrono::hours(24), size_t bucket_count = 1440,
+                          NowFunction now_function = Clock::now);
 
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+        const Clock::time_point start = now_function_();
         auto result = server.FindTopDocuments(raw_query, document_predicate);
+        const Clock::time_point finish = now_function_();
 
-        requests_.push_back({++current_time_sec, result.empty()});
-        no_resul_requests_count += result.empty();
-        while (std::abs(requests_.front().time - current_time_sec) >= min_in_day_){
-            no_resul_requests_count -= requests_.front().is_empty;
-            requests_.pop_front();
-        }
+        AddRequest(finish, finish - start, result.empty());
         return result;
     }
 
@@ -29,17 +50,40 @@ public:
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
     int GetNoResultRequests() const;
+    RequestWindowStats GetWindowStats() const;
 
 private:
-    struct QueryResult {
-        int time = 0;
-        bool is_empty = false;
+    struct alignas(64) Bucket {
+        // Number of the period the counts belong to, RESETTING while they are cleared
+        std::atomic<int64_t> period{EMPTY};
+        std::atomic<uint64_t> request_count{0};
+        std::atomic<uint64_t> no_result_request_count{0};
+        std::atomic<int64_t> latency_ns{0};
+        // Requests adding to the counts, the bucket is only cleared once they are done
+        std::atomic<uint32_t> writer_count{0};
     };
 
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
+    struct alignas(64) Totals {
+        std::atomic<uint64_t> request_count{0};
+        std::atomic<uint64_t> no_result_request_count{0};
+        std::atomic<int64_t> latency_ns{0};
+    };
+
+    inline static constexpr int64_t EMPTY = -1;
+    inline static constexpr int64_t RESETTING = -2;
 
-    int current_time_sec = 0;
     const SearchServer& server;
-    int no_resul_requests_count = 0;
+    const Clock::duration bucket_duration_;
+    const size_t bucket_count_;
+    const NowFunction now_function_;
+    const Clock::time_point start_time_;
+    std::unique_ptr<Bucket[]> buckets_;
+    mutable Totals totals_;
+    // Every period before it has been subtracted from the totals
+    mutable std::atomic<int64_t> first_unexpired_period_{0};
+
+    int64_t GetPeriod(Clock::time_point time) const;
+    void ExpirePeriodsBefore(int64_t period) const;
+    void ClearBucket(Bucket& bucket, bool is_counted) const;
+    void AddRequest(Clock::time_point time, Clock::duration latency, bool is_empty);
 };
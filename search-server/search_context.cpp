@@ -0,0 +1,42 @@
+#include "search_context.h"
+
+//=================================================================================
+SearchContext &SearchContext::ForCurrentThread()
+{
+    static thread_local SearchContext context;
+    return context;
+}
+
+//=================================================================================
+TermCursor::TermCursor(const PostingList &postings, const std::vector<double> &inv_word_counts, double inverse_document_freq)
+    : postings_(&postings)
+    , inv_word_counts_(&inv_word_counts)
+    , inverse_document_freq_(inverse_document_freq)
+    , max_score_(postings.GetMaxTermFreq() * inverse_document_freq)
+    , block_count_(postings.GetBlockCount())
+    , decoded_block_(block_count_)
+{
+    if (!IsAtEnd()) {
+        DecodeBlock();
+    }
+}
+
+//=================================================================================
+size_t TermCursor::GetRemainingCount() const
+{
+    // All blocks but the last one are full
+    return IsAtEnd() ? 0 : postings_->size() - block_ * POSTING_BLOCK_SIZE - position_;
+}
+
+//=================================================================================
+double TermCursor::GetBlockMaxScore() const
+{
+    return postings_->GetBlockMaxTermFreq(block_) * inverse_document_freq_;
+}
+
+//=================================================================================
+void TermCursor::DecodeBlock()
+{
+    size_ = postings_->DecodeBlock(block_, ordinals_.data(), counts_.data());
+    decoded_block_ = block_;
+}
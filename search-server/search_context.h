@@ -0,0 +1,164 @@
+#pragma once
+
+//=================================================================================
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <vector>
+
+//=================================================================================
+#include "document.h"
+#include "document_bitmap.h"
+#include "posting_list.h"
+#include "relevance_accumulator.h"
+#include "top_documents.h"
+
+//=================================================================================
+// Parsed search query, the words point into the query text
+struct ParsedQuery {
+    std::vector<std::string_view> plus_words;
+    std::vector<std::string_view> minus_words;
+    // IDF of every plus word computed from outside statistics (see ShardedSearchServer).
+    // Empty means the server computes IDF from its own documents
+    std::vector<double> plus_word_idfs;
+};
+
+//=================================================================================
+// Position in the postings of one query term. A block is decoded when the cursor enters it,
+// SeekToBlock moves over the skip headers only
+class TermCursor {
+public:
+    TermCursor(const PostingList& postings, const std::vector<double>& inv_word_counts, double inverse_document_freq);
+
+    // Upper bound of the term's contribution to relevance
+    double GetMaxScore() const { return max_score_; }
+    bool IsAtEnd() const { return block_ == block_count_; }
+    int GetOrdinal() const { return ordinals_[position_]; }
+    double GetScore() const { return GetScore(position_); }
+    bool IsAt(int ordinal) const { return !IsAtEnd() && GetOrdinal() == ordinal; }
+    // Number of postings from the current one to the end
+    size_t GetRemainingCount() const;
+
+    // Moves to the block that may hold the given ordinal without decoding it:
+    // only GetBlockMaxScore, SeekTo and IsAtEnd may follow
+    void SeekToBlock(int ordinal);
+    // Upper bound of the scores in the current block
+    double GetBlockMaxScore() const;
+    // Moves to the first posting with ordinal not less than the given one
+    void SeekTo(int ordinal);
+    // Calls function(ordinal, score) for the postings before end_ordinal and moves past them
+    template <typename Function>
+    void ScoreUntil(int end_ordinal, Function function);
+
+    // Scores of an essential term in the window being scored are [window_begin, window_end) of the window buffers
+    size_t window_begin = 0;
+    size_t window_end = 0;
+    bool is_essential = true;
+
+private:
+    const PostingList* postings_;
+    const std::vector<double>* inv_word_counts_;
+    double inverse_document_freq_;
+    double max_score_;
+    size_t block_count_;
+    size_t block_ = 0;
+    size_t decoded_block_;
+    size_t position_ = 0;           // in the decoded block
+    size_t size_ = 0;               // of the decoded block
+    std::array<int, POSTING_BLOCK_SIZE> ordinals_;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> counts_;
+
+    // Term frequencies are computed only for the postings that are scored
+    double GetScore(size_t position) const;
+    void DecodeBlock();
+};
+
+//=================================================================================
+inline double TermCursor::GetScore(size_t position) const
+{
+    return ComputeTermFreq(counts_[position], (*inv_word_counts_)[ordinals_[position]]) * inverse_document_freq_;
+}
+
+//=================================================================================
+inline void TermCursor::SeekToBlock(int ordinal)
+{
+    if (!IsAtEnd() && postings_->GetBlockLastOrdinal(block_) < ordinal) {
+        block_ = postings_->FindBlock(ordinal, block_ + 1);
+        position_ = 0;
+    }
+}
+
+//=================================================================================
+inline void TermCursor::SeekTo(int ordinal)
+{
+    SeekToBlock(ordinal);
+    if (IsAtEnd()) {
+        return;
+    }
+    if (decoded_block_ != block_) {
+        DecodeBlock();
+    }
+    position_ = std::lower_bound(ordinals_.begin() + position_, ordinals_.begin() + size_, ordinal) - ordinals_.begin();
+}
+
+//=================================================================================
+template <typename Function>
+void TermCursor::ScoreUntil(int end_ordinal, Function function)
+{
+    const double* inv_word_counts = inv_word_counts_->data();
+    while (!IsAtEnd()) {
+        if (decoded_block_ != block_) {
+            DecodeBlock();
+        }
+        const int* ordinals = ordinals_.data();
+        const size_t end = ordinals[size_ - 1] < end_ordinal
+                ? size_
+                : std::lower_bound(ordinals + position_, ordinals + size_, end_ordinal) - ordinals;
+        for (size_t i = position_; i < end; ++i) {
+            function(ordinals[i], ComputeTermFreq(counts_[i], inv_word_counts[ordinals[i]]) * inverse_document_freq_);
+        }
+        position_ = end;
+        if (end != size_) {
+            return;
+        }
+        ++block_;
+        position_ = 0;
+    }
+}
+
+//=================================================================================
+// Scratch buffers of sequential queries: tokens, parsed query, relevance sums, term cursors, top-K heap and results.
+// They keep their capacity between queries, so a warmed-up query performs no heap allocations.
+// A context may be used with any SearchServer, but by one thread at a time
+class SearchContext {
+public:
+    SearchContext() = default;
+
+    SearchContext(const SearchContext&) = delete;
+    SearchContext& operator=(const SearchContext&) = delete;
+
+    // Context used by the calls that are not given one
+    static SearchContext& ForCurrentThread();
+
+private:
+    friend class SearchServer;
+    friend class BatchQueryExecutor;
+
+    std::vector<std::string_view> words_;
+    ParsedQuery query_;
+    RelevanceAccumulator accumulator_;
+    TopDocuments top_documents_{0};
+    std::vector<Document> documents_;
+    std::vector<std::string_view> matched_words_;
+    std::vector<int> plus_term_ids_;            // of MatchDocument, sorted
+    std::vector<int> minus_term_ids_;
+    DocumentBitmap minus_word_ordinals_;
+    DocumentBitmap allowed_ordinals_;
+
+    std::vector<TermCursor> cursors_;           // in the order of the plus words
+    std::vector<size_t> cursor_order_;          // cursor indexes by increasing max score
+    std::vector<double> max_score_prefix_sums_; // along cursor_order_
+    // Postings of the essential terms in the window being scored, see TermCursor::window_begin
+    std::vector<int> window_ordinals_;
+    std::vector<double> window_scores_;
+};
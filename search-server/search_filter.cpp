@@ -0,0 +1,72 @@
+#include "search_filter.h"
+
+//=================================================================================
+#include <algorithm>
+#include <stdexcept>
+
+//=================================================================================
+SearchFilter::SearchFilter(DocumentStatus status)
+{
+    SetStatuses({status});
+}
+
+//=================================================================================
+SearchFilter &SearchFilter::SetStatuses(std::initializer_list<DocumentStatus> statuses)
+{
+    uint32_t status_mask = 0;
+    for (const DocumentStatus status : statuses){
+        // Also rejects negative values, which turn into large ones
+        if (static_cast<uint32_t>(status) > static_cast<uint32_t>(DocumentStatus::REMOVED)){
+            throw std::invalid_argument("invalid document status");
+        }
+        status_mask |= uint32_t{1} << static_cast<uint32_t>(status);
+    }
+    status_mask_ = status_mask;
+    return *this;
+}
+
+//=================================================================================
+SearchFilter &SearchFilter::SetRatingRange(int min_rating, int max_rating)
+{
+    if (min_rating > max_rating){
+        throw std::invalid_argument("empty rating range");
+    }
+    min_rating_ = min_rating;
+    max_rating_ = max_rating;
+    return *this;
+}
+
+//=================================================================================
+SearchFilter &SearchFilter::SetIdRange(int min_id, int max_id)
+{
+    if (min_id > max_id){
+        throw std::invalid_argument("empty id range");
+    }
+    min_id_ = min_id;
+    max_id_ = max_id;
+    return *this;
+}
+
+//=================================================================================
+SearchFilter &SearchFilter::SetAllowedIds(std::vector<int> ids)
+{
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    allowed_ids_ = std::move(ids);
+    return *this;
+}
+
+//=================================================================================
+const std::vector<int> *SearchFilter::GetAllowedIds() const
+{
+    return allowed_ids_ ? &*allowed_ids_ : nullptr;
+}
+
+//=================================================================================
+bool SearchFilter::operator()(int document_id, DocumentStatus status, int rating) const
+{
+    return AcceptsStatus(status)
+            && rating >= min_rating_ && rating <= max_rating_
+            && document_id >= min_id_ && document_id <= max_id_
+            && (!allowed_ids_ || std::binary_search(allowed_ids_->begin(), allowed_ids_->end(), document_id));
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+//=================================================================================
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <optional>
+#include <vector>
+
+//=================================================================================
+#include "document.h"
+#include "document_bitmap.h"
+
+//=================================================================================
+// Declarative filter of FindTopDocuments: a set of statuses, inclusive ranges of rating and id and an optional
+// allow-list of ids. The server checks it against its per-document columns before scoring, without calling back.
+// It is also a predicate, so it works wherever a predicate lambda does. A default filter accepts every document
+class SearchFilter {
+public:
+    SearchFilter() = default;
+    // This constructor and SetStatuses throw std::invalid_argument for a status out of the DocumentStatus values
+    explicit SearchFilter(DocumentStatus status);
+
+    SearchFilter& SetStatuses(std::initializer_list<DocumentStatus> statuses);
+    SearchFilter& SetRatingRange(int min_rating, int max_rating);
+    SearchFilter& SetIdRange(int min_id, int max_id);
+    SearchFilter& SetAllowedIds(std::vector<int> ids);
+
+    // Bit 1 << status of every accepted status
+    uint32_t GetStatusMask() const { return status_mask_; }
+    bool AcceptsStatus(DocumentStatus status) const;
+    int GetMinRating() const { return min_rating_; }
+    int GetMaxRating() const { return max_rating_; }
+    int GetMinId() const { return min_id_; }
+    int GetMaxId() const { return max_id_; }
+    // Sorted distinct ids, nullptr if any id is allowed
+    const std::vector<int>* GetAllowedIds() const;
+
+    bool operator()(int document_id, DocumentStatus status, int rating) const;
+
+    static constexpr uint32_t ALL_STATUSES = ~uint32_t{0};
+
+private:
+    uint32_t status_mask_ = ALL_STATUSES;
+    int min_rating_ = std::numeric_limits<int>::min();
+    int max_rating_ = std::numeric_limits<int>::max();
+    int min_id_ = std::numeric_limits<int>::min();
+    int max_id_ = std::numeric_limits<int>::max();
+    std::optional<std::vector<int>> allowed_ids_;
+};
+
+//=================================================================================
+inline bool SearchFilter::AcceptsStatus(DocumentStatus status) const
+{
+    // A status out of range, which no document has, is not accepted
+    const uint32_t status_bit = static_cast<uint32_t>(status);
+    return status_bit <= static_cast<uint32_t>(DocumentStatus::REMOVED) && ((status_mask_ >> status_bit) & 1);
+}
+
+//=================================================================================
+// Filter of the documents a query may score, by document ordinal. Every condition is skipped while its
+// pointer is nullptr: the ordinal is in none of excluded and in allowed, and the column values are in range
+struct DocumentFilter {
+    const DocumentBitmap* excluded = nullptr;
+    const DocumentBitmap* allowed = nullptr;
+    const DocumentStatus* statuses = nullptr;   // with status_mask as in SearchFilter
+    uint32_t status_mask = SearchFilter::ALL_STATUSES;
+    const int* ratings = nullptr;
+    int min_rating = 0;
+    int max_rating = 0;
+    const int* document_ids = nullptr;
+    int min_id = 0;
+    int max_id = 0;
+
+    bool Accepts(int ordinal) const;
+};
+
+//=================================================================================
+inline bool DocumentFilter::Accepts(int ordinal) const
+{
+    return (excluded == nullptr || !excluded->Contains(ordinal))
+            && (allowed == nullptr || allowed->Contains(ordinal))
+            && (statuses == nullptr || ((status_mask >> static_cast<uint32_t>(statuses[ordinal])) & 1))
+            && (ratings == nullptr || (ratings[ordinal] >= min_rating && ratings[ordinal] <= max_rating))
+            && (document_ids == nullptr || (document_ids[ordinal] >= min_id && document_ids[ordinal] <= max_id));
+}
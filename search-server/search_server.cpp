@@ -2,11 +2,45 @@
 #include <numeric>
 #include <list>
 #include <future>
+#include <stdexcept>
 
 #include <cassert>
 
 //=================================================================================
 #include "search_server.h"
+#include "index_snapshot.h"
+
+//=================================================================================
+namespace {
+
+// 128-bit fingerprint of a sorted set of term ids: two independent 64-bit multiplicative hashes
+struct Fingerprint {
+    uint64_t high;
+    uint64_t low;
+
+    bool operator<(const Fingerprint& other) const { return std::tie(high, low) < std::tie(other.high, other.low); }
+    bool operator==(const Fingerprint& other) const { return high == other.high && low == other.low; }
+};
+
+// Finalizer of splitmix64
+inline uint64_t MixBits(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
+
+inline Fingerprint ComputeFingerprint(const std::vector<int>& term_ids)
+{
+    Fingerprint fingerprint{0x9e3779b97f4a7c15, term_ids.size()};
+    for (const int term_id : term_ids){
+        fingerprint.high = MixBits(fingerprint.high ^ static_cast<uint32_t>(term_id));
+        fingerprint.low = MixBits(fingerprint.low + 0x632be59bd9b4e019 * (static_cast<uint64_t>(term_id) + 1));
+    }
+    return fingerprint;
+}
+
+}
 
 //=================================================================================
 SearchServer::SearchServer(const std::string_view stop_words_text) : SearchServer(SplitIntoWords(stop_words_text)) {}
@@ -15,53 +49,116 @@ SearchServer::SearchServer(const std::string_view stop_words_text) : SearchServe
 SearchServer::SearchServer(const std::string stop_words_text) : SearchServer(std::string_view(stop_words_text)) {}
 
 //=================================================================================
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]]int rating) { return document_status == status; });
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const {
+    return FindTopDocuments(SearchContext::ForCurrentThread(), raw_query, status, options);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::sequenced_policy, const std::string_view raw_query, DocumentStatus status) const
+std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::sequenced_policy, const std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const
 {
-    return FindTopDocuments(std::execution::seq, raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]]int rating) { return document_status == status; });
+    return FindTopDocuments(SearchContext::ForCurrentThread(), raw_query, status, options);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::parallel_policy, const std::string_view raw_query, DocumentStatus status) const
+std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::parallel_policy, const std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const
 {
-    return FindTopDocuments(std::execution::par, raw_query, [status]([[maybe_unused]] int document_id, DocumentStatus document_status, [[maybe_unused]]int rating) { return document_status == status; });
+    METRIC_DURATION("search_server.find_top_documents.par");
+    Query query = ParseQuery(raw_query);
+
+    SortQuery(query);
+
+    const SearchFilter filter(status);
+    std::vector<Document> documents;
+    SelectCachedTopDocuments(query, status, options, documents, [&](std::vector<Document>& selected){
+        selected = SelectTopDocuments(std::execution::par, query, filter, options);
+    });
+    return documents;
+}
+
+//=================================================================================
+const std::vector<Document> &SearchServer::FindTopDocuments(SearchContext &context, const std::string_view raw_query, DocumentStatus status, const SearchOptions &options) const
+{
+    METRIC_DURATION("search_server.find_top_documents");
+    ParseQuery(raw_query, context.query_, context.words_);
+
+    SortQuery(context.query_);
+
+    const SearchFilter filter(status);
+    SelectCachedTopDocuments(context.query_, status, options, context.documents_, [&](std::vector<Document>&){
+        SelectTopDocuments(context.query_, filter, options, context);
+    });
+    return context.documents_;
+}
+
+//=================================================================================
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, const SearchFilter &filter, const SearchOptions &options) const
+{
+    return FindTopDocuments(SearchContext::ForCurrentThread(), raw_query, filter, options);
+}
+
+//=================================================================================
+std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::sequenced_policy, const std::string_view raw_query, const SearchFilter &filter, const SearchOptions &options) const
+{
+    return FindTopDocuments(SearchContext::ForCurrentThread(), raw_query, filter, options);
+}
+
+//=================================================================================
+std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::parallel_policy, const std::string_view raw_query, const SearchFilter &filter, const SearchOptions &options) const
+{
+    METRIC_DURATION("search_server.find_top_documents.par");
+    Query query = ParseQuery(raw_query);
+
+    SortQuery(query);
+
+    return SelectTopDocuments(std::execution::par, query, filter, options);
+}
+
+//=================================================================================
+const std::vector<Document> &SearchServer::FindTopDocuments(SearchContext &context, const std::string_view raw_query, const SearchFilter &filter, const SearchOptions &options) const
+{
+    METRIC_DURATION("search_server.find_top_documents");
+    ParseQuery(raw_query, context.query_, context.words_);
+
+    SortQuery(context.query_);
+
+    SelectTopDocuments(context.query_, filter, options, context);
+    return context.documents_;
+}
+
+//=================================================================================
+void SearchServer::SetQueryCacheCapacity(size_t capacity)
+{
+    if (capacity == 0){
+        query_cache_.reset();
+    } else {
+        query_cache_ = std::make_unique<QueryResultCache>(capacity);
+    }
+}
+
+//=================================================================================
+QueryCacheStats SearchServer::GetQueryCacheStats() const
+{
+    return query_cache_ ? query_cache_->GetStats() : QueryCacheStats{};
 }
 
 
 //=================================================================================
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_id_to_ordinal_.size();
 }
 
 //=================================================================================
 int SearchServer::GetDocumentId(int index) const
 {
-    if (index < 0 || static_cast<size_t>(index) > documents_.size() - 1){
+    if (index < 0 || static_cast<size_t>(index) >= live_document_ids_.size()){
         throw std::out_of_range("Индекс документа больше количества документов на вервере");
     }
-    int doc_index = 0;
-    int doc_id = INVALID_DOCUMENT_ID;
-    for (const auto& [key, value] : documents_){
-        if (doc_index == index){
-            doc_id = key;
-            break;
-        }
-        ++doc_index;
-    }
-    return doc_id;
+    return live_document_ids_[index];
 }
 
 //=================================================================================
 void SearchServer::RemoveDocument(int document_id)
 {
-    for(auto &[word, mapa] : word_to_document_freqs_){
-        mapa.erase(document_id);
-    }
-    document_to_word_freqs.erase(document_id);
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
+    METRIC_DURATION("search_server.remove_document");
+    RemoveDocuments(std::execution::seq, {document_id});
 }
 
 //=================================================================================
@@ -73,46 +170,319 @@ void SearchServer::RemoveDocument([[maybe_unused]] __pstl::execution::sequenced_
 //=================================================================================
 void SearchServer::RemoveDocument([[maybe_unused]] __pstl::execution::parallel_policy &policy, int document_id)
 {
-    if (!document_ids_.count(document_id))
+    METRIC_DURATION("search_server.remove_document.par");
+    RemoveDocuments(std::execution::par, {document_id});
+}
+
+//=================================================================================
+void SearchServer::RemoveDocuments(const std::vector<int> &document_ids)
+{
+    RemoveDocuments(std::execution::seq, document_ids);
+}
+
+//=================================================================================
+void SearchServer::RemoveDocuments([[maybe_unused]] const std::execution::sequenced_policy &policy, const std::vector<int> &document_ids)
+{
+    const std::vector<int> term_ids = MarkDocumentsRemoved(document_ids);
+    if (IsOrdinalCompactionDue()){
+        const std::vector<int> new_ordinals = CompactOrdinals();
+        for (PostingList& postings : term_postings_){
+            postings.Renumber(new_ordinals, inv_word_counts_);
+        }
         return;
+    }
+    for (const int term_id : term_ids){
+        CompactPostings(term_id);
+    }
+}
 
-    const auto& doc_words_freqs = document_to_word_freqs.at(document_id);
+//=================================================================================
+void SearchServer::RemoveDocuments(const std::execution::parallel_policy &policy, const std::vector<int> &document_ids)
+{
+    const std::vector<int> term_ids = MarkDocumentsRemoved(document_ids);
+    if (IsOrdinalCompactionDue()){
+        const std::vector<int> new_ordinals = CompactOrdinals();
+        std::for_each(policy, term_postings_.begin(), term_postings_.end(), [this, &new_ordinals](PostingList& postings){
+            postings.Renumber(new_ordinals, inv_word_counts_);
+        });
+        return;
+    }
+    std::for_each(policy, term_ids.begin(), term_ids.end(), [this](int term_id){
+        CompactPostings(term_id);
+    });
+}
 
-    std::vector<std::string_view> doc_words(doc_words_freqs.size());
-    for (const auto &[word, freq] : doc_words_freqs){
-        doc_words.push_back(word);
+//=================================================================================
+PostingListStats SearchServer::GetPostingListStats(const std::string_view word) const
+{
+    const int term_id = FindTermId(word);
+    if (term_id == INVALID_TERM_ID){
+        return {};
     }
+    PostingListStats stats;
+    stats.posting_count = term_postings_[term_id].size();
+    stats.removed_posting_count = stats.posting_count - terms_[term_id].document_count;
+    return stats;
+}
 
-    for_each(policy, doc_words.begin(),doc_words.end(),
-             [&](const auto& word) {
-            word_to_document_freqs_[word].erase(document_id); });
+//=================================================================================
+const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const
+{
+    static const std::map<std::string_view, double> empty_word_freqs;
+    const auto iter = document_id_to_ordinal_.find(document_id);
+    if (iter == document_id_to_ordinal_.end()){
+        return empty_word_freqs;
+    }
+    const int ordinal = iter->second;
 
-    document_to_word_freqs.erase(document_id);
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
+    // Nodes of the cache are never moved, the returned map stays in place while other documents are added
+    std::lock_guard guard(word_frequency_cache_.mutex);
+    const auto [cached, is_new] = word_frequency_cache_.ordinal_to_word_freqs.try_emplace(ordinal);
+    std::map<std::string_view, double>& word_freqs = cached->second;
+    if (is_new){
+        const std::vector<int>& term_ids = document_term_ids_[ordinal];
+        const std::vector<uint32_t>& term_counts = document_term_counts_[ordinal];
+        for (size_t i = 0; i < term_ids.size(); ++i){
+            word_freqs.emplace(terms_[term_ids[i]].text, ComputeTermFreq(term_counts[i], inv_word_counts_[ordinal]));
+        }
+    }
+    return word_freqs;
 }
 
 //=================================================================================
-const std::map<std::string_view, double> &SearchServer::GetWordFrequencies(int document_id) const
+std::vector<int> SearchServer::FindDuplicateDocuments() const
 {
-    if (document_to_word_freqs.count(document_id)){
-        return document_to_word_freqs.at(document_id);
-    } else {
-        static std::map<std::string_view, double> empty;
-        return empty;
+    // Removed documents have no terms, their fingerprints are dropped before sorting
+    std::vector<std::pair<Fingerprint, int>> fingerprints(live_ordinals_.size());
+    std::transform(std::execution::par,
+                   live_ordinals_.begin(), live_ordinals_.end(),
+                   fingerprints.begin(),
+                   [this](int ordinal){
+        return std::pair{ComputeFingerprint(document_term_ids_[ordinal]), ordinal};
+    });
+    fingerprints.erase(std::remove_if(fingerprints.begin(), fingerprints.end(), [this](const auto& fingerprint){
+                           return removed_ordinals_[fingerprint.second];
+                       }), fingerprints.end());
+    std::sort(std::execution::par, fingerprints.begin(), fingerprints.end(), [this](const auto& lhs, const auto& rhs){
+        return std::tie(lhs.first, ordinal_to_document_id_[lhs.second]) < std::tie(rhs.first, ordinal_to_document_id_[rhs.second]);
+    });
+
+    // A run of equal fingerprints is by increasing id: a document duplicates one of the kept documents of the run
+    // or is kept itself. Without collisions the first one is kept and compared with the rest
+    std::vector<int> duplicate_ids;
+    std::vector<int> kept_ordinals;
+    for (size_t run = 0; run < fingerprints.size();){
+        size_t run_end = run + 1;
+        while (run_end < fingerprints.size() && fingerprints[run_end].first == fingerprints[run].first){
+            ++run_end;
+        }
+        kept_ordinals.clear();
+        for (size_t i = run; i < run_end; ++i){
+            const std::vector<int>& term_ids = document_term_ids_[fingerprints[i].second];
+            const bool is_duplicate = std::any_of(kept_ordinals.begin(), kept_ordinals.end(), [this, &term_ids](int kept){
+                return document_term_ids_[kept] == term_ids;
+            });
+            if (is_duplicate){
+                duplicate_ids.push_back(ordinal_to_document_id_[fingerprints[i].second]);
+            } else {
+                kept_ordinals.push_back(fingerprints[i].second);
+            }
+        }
+        run = run_end;
+    }
+    std::sort(duplicate_ids.begin(), duplicate_ids.end());
+    return duplicate_ids;
+}
+
+//=================================================================================
+void SearchServer::SaveSnapshot(const std::string &path) const
+{
+    SnapshotWriter writer(path);
+
+    writer.Write<uint64_t>(stop_words_.size());
+    for (const std::string& word : stop_words_){
+        writer.Write<uint32_t>(word.size());
+        writer.WriteBytes(word.data(), word.size());
+    }
+
+    // Terms: offsets into one blob of term texts, then reference counts
+    writer.Write<uint64_t>(terms_.size());
+    uint64_t offset = 0;
+    writer.Write<uint64_t>(offset);
+    for (const TermData& term : terms_){
+        offset += term.text.size();
+        writer.Write<uint64_t>(offset);
+    }
+    for (const TermData& term : terms_){
+        writer.WriteBytes(term.text.data(), term.text.size());
+    }
+    for (const TermData& term : terms_){
+        writer.Write<uint64_t>(term.document_count);
+    }
+
+    // Posting lists are stored packed, as they are in memory
+    for (const PostingList& postings : term_postings_){
+        postings.Save(writer);
+    }
+
+    // Documents in ordinal order; removed ordinals have INVALID_DOCUMENT_ID and no data,
+    // but keep their word counts for the postings that are not compacted yet.
+    // The data of live documents is stored by column, terms of all documents in one array with offsets
+    writer.Write<uint64_t>(ordinal_to_document_id_.size());
+    writer.WriteArray(ordinal_to_document_id_.data(), ordinal_to_document_id_.size());
+    writer.WriteArray(inv_word_counts_.data(), inv_word_counts_.size());
+    std::vector<int> live_ordinals;
+    live_ordinals.reserve(document_id_to_ordinal_.size());
+    std::copy_if(live_ordinals_.begin(), live_ordinals_.end(), std::back_inserter(live_ordinals), [this](int ordinal){
+        return !removed_ordinals_[ordinal];
+    });
+    for (const int ordinal : live_ordinals){
+        writer.Write<int32_t>(document_ratings_[ordinal]);
+    }
+    for (const int ordinal : live_ordinals){
+        writer.Write<int32_t>(static_cast<int32_t>(document_statuses_[ordinal]));
+    }
+    uint64_t term_offset = 0;
+    writer.Write<uint64_t>(term_offset);
+    for (const int ordinal : live_ordinals){
+        term_offset += document_term_ids_[ordinal].size();
+        writer.Write<uint64_t>(term_offset);
+    }
+    for (const int ordinal : live_ordinals){
+        writer.WriteArray(document_term_ids_[ordinal].data(), document_term_ids_[ordinal].size());
+    }
+    for (const int ordinal : live_ordinals){
+        writer.WriteArray(document_term_counts_[ordinal].data(), document_term_counts_[ordinal].size());
+    }
+
+    writer.Finish();
+}
+
+//=================================================================================
+void SearchServer::LoadSnapshot(const std::string &path)
+{
+    const MappedFile file(path);
+    SnapshotReader reader(file);
+    SearchServer server{std::string_view()};
+
+    const auto check = [](bool condition){
+        if (!condition){
+            throw std::runtime_error("snapshot is corrupted");
+        }
+    };
+
+    const uint64_t stop_word_count = reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < stop_word_count; ++i){
+        const uint32_t size = reader.Read<uint32_t>();
+        server.stop_words_.emplace(reader.ReadBytes(size), size);
+    }
+
+    // All term texts are copied into the arena with a single store
+    const uint64_t term_count = reader.Read<uint64_t>();
+    std::vector<uint64_t> term_offsets(term_count + 1);
+    reader.ReadArray(term_offsets.data(), term_offsets.size());
+    check(term_offsets.front() == 0 && std::is_sorted(term_offsets.begin(), term_offsets.end()));
+    const std::string_view term_texts = server.term_arena_.Store({reader.ReadBytes(term_offsets.back()), term_offsets.back()});
+    std::vector<uint64_t> term_document_counts(term_count);
+    reader.ReadArray(term_document_counts.data(), term_document_counts.size());
+
+    server.terms_.reserve(term_count);
+    server.word_to_term_id_.reserve(term_count);
+    server.term_postings_.resize(term_count);
+    for (uint64_t term_id = 0; term_id < term_count; ++term_id){
+        const std::string_view text = term_texts.substr(term_offsets[term_id], term_offsets[term_id + 1] - term_offsets[term_id]);
+        server.terms_.push_back({text, term_document_counts[term_id]});
+        check(server.word_to_term_id_.emplace(text, static_cast<int>(term_id)).second);
+
+        PostingList& postings = server.term_postings_[term_id];
+        postings.Load(reader);
+        check(postings.size() >= term_document_counts[term_id]);
+    }
+
+    const uint64_t ordinal_count = reader.Read<uint64_t>();
+    check(ordinal_count <= static_cast<uint64_t>(std::numeric_limits<int>::max()));
+    server.ordinal_to_document_id_.resize(ordinal_count);
+    reader.ReadArray(server.ordinal_to_document_id_.data(), ordinal_count);
+    server.inv_word_counts_.resize(ordinal_count);
+    reader.ReadArray(server.inv_word_counts_.data(), ordinal_count);
+    server.removed_ordinals_.resize(ordinal_count);
+    std::vector<int> live_document_ids;
+    for (uint64_t ordinal = 0; ordinal < ordinal_count; ++ordinal){
+        const int document_id = server.ordinal_to_document_id_[ordinal];
+        if (document_id == INVALID_DOCUMENT_ID){
+            server.removed_ordinals_[ordinal] = true;
+            continue;
+        }
+        check(server.IsValidDocumentId(document_id) && server.IsUniqueDocumentId(document_id));
+        server.document_id_to_ordinal_.emplace(document_id, static_cast<int>(ordinal));
+        server.live_ordinals_.push_back(static_cast<int>(ordinal));
+        live_document_ids.push_back(document_id);
+    }
+    server.live_document_ids_.Assign(std::move(live_document_ids));
+
+    // Columns of the live documents, in the order of their ordinals
+    const size_t live_count = server.live_ordinals_.size();
+    std::vector<int32_t> ratings(live_count);
+    reader.ReadArray(ratings.data(), live_count);
+    std::vector<int32_t> statuses(live_count);
+    reader.ReadArray(statuses.data(), live_count);
+    std::vector<uint64_t> term_offsets_by_document(live_count + 1);
+    reader.ReadArray(term_offsets_by_document.data(), live_count + 1);
+    check(term_offsets_by_document.front() == 0 && std::is_sorted(term_offsets_by_document.begin(), term_offsets_by_document.end()));
+    const uint64_t posting_count = term_offsets_by_document.back();
+    std::vector<int> document_term_ids(posting_count);
+    reader.ReadArray(document_term_ids.data(), posting_count);
+    std::vector<uint32_t> document_term_counts(posting_count);
+    reader.ReadArray(document_term_counts.data(), posting_count);
+    check(std::all_of(document_term_ids.begin(), document_term_ids.end(), [term_count](int term_id){
+        return term_id >= 0 && static_cast<uint64_t>(term_id) < term_count;
+    }));
+
+    server.document_statuses_.resize(ordinal_count, DocumentStatus::REMOVED);
+    server.document_ratings_.resize(ordinal_count, 0);
+    server.document_term_ids_.resize(ordinal_count);
+    server.document_term_counts_.resize(ordinal_count);
+    for (size_t i = 0; i < live_count; ++i){
+        const int ordinal = server.live_ordinals_[i];
+        server.document_ratings_[ordinal] = ratings[i];
+        server.document_statuses_[ordinal] = static_cast<DocumentStatus>(statuses[i]);
+        check(IsValidDocumentStatus(server.document_statuses_[ordinal]));
+        server.status_ordinals_[statuses[i]].Add(ordinal);
+        const auto first = term_offsets_by_document[i];
+        const auto last = term_offsets_by_document[i + 1];
+        server.document_term_ids_[ordinal].assign(document_term_ids.begin() + first, document_term_ids.begin() + last);
+        server.document_term_counts_[ordinal].assign(document_term_counts.begin() + first, document_term_counts.begin() + last);
+    }
+    check(reader.IsAtEnd());
+
+    // Loaded lists are sorted and start from 0 or later, so the last ordinal is enough
+    for (const PostingList& postings : server.term_postings_){
+        check(postings.empty() || static_cast<uint64_t>(postings.GetBlockLastOrdinal(postings.GetBlockCount() - 1)) < ordinal_count);
     }
+
+    // The IDF table is computed once for the loaded counts
+    server.term_idfs_.Resize(term_count);
+    for (uint64_t term_id = 0; term_id < term_count; ++term_id){
+        server.UpdateTermInverseDocumentFreq(static_cast<int>(term_id));
+    }
+    server.UpdateInverseDocumentFreqs();
+
+    // The cache settings survive loading, cached results do not
+    server.index_epoch_ = index_epoch_ + 1;
+    server.query_cache_ = std::move(query_cache_);
+    *this = std::move(server);
 }
 
 //=================================================================================
-std::set<int>::const_iterator SearchServer::begin() const
+std::vector<int>::const_iterator SearchServer::begin() const
 {
-    return document_ids_.cbegin();
+    return live_document_ids_.begin();
 }
 
 //=================================================================================
-std::set<int>::const_iterator SearchServer::end() const
+std::vector<int>::const_iterator SearchServer::end() const
 {
-    return document_ids_.cend();
+    return live_document_ids_.end();
 }
 
 //=================================================================================
@@ -123,76 +493,124 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 //=================================================================================
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument([[maybe_unused]] const std::execution::sequenced_policy &policy, const std::string_view raw_query, int document_id) const
 {
-    CheckDocumentIdExistence(document_id);
+    const auto [matched_words, status] = MatchDocument(SearchContext::ForCurrentThread(), raw_query, document_id);
+    return {matched_words, status};
+}
 
-    const Query &query = ParseQuery(raw_query);     // FIXED
-    std::vector<std::string_view> matched_words;
+//=================================================================================
+std::tuple<const std::vector<std::string_view>&, DocumentStatus> SearchServer::MatchDocument(SearchContext &context, const std::string_view raw_query, int document_id) const
+{
+    METRIC_DURATION("search_server.match_document");
+    const int ordinal = GetDocumentOrdinal(document_id);
 
-    const auto &document_words = documents_.at(document_id).text;
+    ParseQuery(raw_query, context.query_, context.words_);
+    FindQueryTermIds(context.query_, context.plus_term_ids_, context.minus_term_ids_);
+    MatchDocumentTerms(ordinal, context.plus_term_ids_, context.minus_term_ids_, context.matched_words_);
 
-    for (const std::string& word : document_words){
-        auto iter = std::find(query.plus_words.begin(), query.plus_words.end(), word);
-        if (iter != query.plus_words.end()){
-            matched_words.push_back(word);
-        }
-    }
+    return {context.matched_words_, document_statuses_[ordinal]};
+}
 
-    for (const std::string& word : document_words){
-        auto iter = std::find(query.minus_words.begin(), query.minus_words.end(), word);
-        if (iter != query.minus_words.end()){
-            matched_words.clear();
-            break;
-        }
-    }
+//=================================================================================
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument([[maybe_unused]] const std::execution::parallel_policy &policy, const std::string_view raw_query, int document_id) const
+{
+    METRIC_DURATION("search_server.match_document.par");
+    // Matching one document costs less than the tasks of a parallel algorithm, the policy is kept for MatchDocuments
+    const int ordinal = GetDocumentOrdinal(document_id);
 
-    std::sort(matched_words.begin(), matched_words.end());
-    matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+    const Query query = ParseQuery(raw_query);
+    std::vector<int> plus_term_ids;
+    std::vector<int> minus_term_ids;
+    FindQueryTermIds(query, plus_term_ids, minus_term_ids);
+    std::vector<std::string_view> matched_words;
+    MatchDocumentTerms(ordinal, plus_term_ids, minus_term_ids, matched_words);
 
-    return {matched_words, documents_.at(document_id).status};//
+    return {matched_words, document_statuses_[ordinal]};
 }
 
 //=================================================================================
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument([[maybe_unused]] const std::execution::parallel_policy &policy, const std::string_view raw_query, int document_id) const
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(const std::string_view raw_query, const std::vector<int> &document_ids) const
+{
+    return MatchDocuments(std::execution::par, raw_query, document_ids);
+}
+
+//=================================================================================
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(const std::execution::sequenced_policy &policy, const std::string_view raw_query, const std::vector<int> &document_ids) const
 {
-    CheckDocumentIdExistence(document_id);
+    return MatchDocumentsImpl(policy, raw_query, document_ids);
+}
 
-    const Query &query = ParseQuery(raw_query);    // FIXED
+//=================================================================================
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(const std::execution::parallel_policy &policy, const std::string_view raw_query, const std::vector<int> &document_ids) const
+{
+    return MatchDocumentsImpl(policy, raw_query, document_ids);
+}
 
-    const auto check_word = [&document_id, this](const auto& word) {
-        return document_to_word_freqs.at(document_id).count(word) > 0;
+//=================================================================================
+void SearchServer::FindQueryTermIds(const Query &query, std::vector<int> &plus_term_ids, std::vector<int> &minus_term_ids) const
+{
+    const auto find_term_ids = [this](const std::vector<std::string_view>& words, std::vector<int>& term_ids){
+        term_ids.clear();
+        for (const std::string_view word : words){
+            const int term_id = FindTermId(word);
+            if (term_id != INVALID_TERM_ID){
+                term_ids.push_back(term_id);
+            }
+        }
+        std::sort(term_ids.begin(), term_ids.end());
+        term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
     };
+    find_term_ids(query.plus_words, plus_term_ids);
+    find_term_ids(query.minus_words, minus_term_ids);
+}
 
-    if (std::any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(), check_word)) {
-        return {std::vector<std::string_view>(), documents_.at(document_id).status};
-    }
-
-    std::vector<std::string_view> matched_words(query.plus_words.size());
-    auto words_end = std::copy_if(std::execution::par,
-                                  query.plus_words.begin(), query.plus_words.end(),
-                                  matched_words.begin(),
-                                  check_word);
+//=================================================================================
+void SearchServer::MatchDocumentTerms(int ordinal, const std::vector<int> &plus_term_ids, const std::vector<int> &minus_term_ids,
+                                      std::vector<std::string_view> &matched_words) const
+{
+    matched_words.clear();
+    const std::vector<int>& document_term_ids = document_term_ids_[ordinal];
 
-    std::sort(matched_words.begin(), words_end);
-    matched_words.erase(std::unique(matched_words.begin(), words_end), matched_words.end());
+    auto position = document_term_ids.begin();
+    for (const int term_id : minus_term_ids){
+        position = std::lower_bound(position, document_term_ids.end(), term_id);
+        if (position == document_term_ids.end()){
+            break;
+        }
+        if (*position == term_id){
+            return;
+        }
+    }
 
-    return {matched_words, documents_.at(document_id).status};
+    position = document_term_ids.begin();
+    for (const int term_id : plus_term_ids){
+        position = std::lower_bound(position, document_term_ids.end(), term_id);
+        if (position == document_term_ids.end()){
+            break;
+        }
+        if (*position == term_id){
+            matched_words.push_back(terms_[term_id].text);
+        }
+    }
+    std::sort(matched_words.begin(), matched_words.end());
 }
 
 //=================================================================================
-void SearchServer::CheckDocumentIdExistence(const int id) const
+int SearchServer::GetDocumentOrdinal(const int id) const
 {
-    if (!document_ids_.count(id))
+    const auto iter = document_id_to_ordinal_.find(id);
+    if (iter == document_id_to_ordinal_.end())
         throw std::invalid_argument("invalid document id");
+    return iter->second;
 }
 
 //=================================================================================
-void SearchServer::CheckWord(const std::string_view word) const
+void SearchServer::CheckWord(const std::string_view word, bool check_special_symbols) const
 {
     if (IsEmptyWord(word)){
         throw std::invalid_argument("empty word");
     } else if (IsWordStartWithMinus(word)){
         throw std::invalid_argument("extra sign \'-\': " + std::string(word));
-    } else if (IsContainSpecialSymbols(word)){
+    } else if (check_special_symbols && IsContainSpecialSymbols(word)){
         throw std::invalid_argument("word contain special symbols: " + std::string(word));
     }
 }
@@ -239,18 +657,31 @@ bool SearchServer::IsValidDocumentId(const int id) const
 //=================================================================================
 bool SearchServer::IsUniqueDocumentId(const int id) const
 {
-    return document_ids_.count(id) == 0;
+    return document_id_to_ordinal_.count(id) == 0;
 }
 
 //=================================================================================
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
-    std::vector<std::string_view > words;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+void SearchServer::CheckOrdinalCount(size_t added_count) const
+{
+    if (added_count > MAX_ORDINAL_COUNT - ordinal_to_document_id_.size()){
+        throw std::length_error("too many documents: " + std::to_string(ordinal_to_document_id_.size() + added_count));
+    }
+}
+
+//=================================================================================
+bool SearchServer::IsValidDocumentStatus(DocumentStatus status)
+{
+    return static_cast<size_t>(status) < DOCUMENT_STATUS_COUNT;
+}
+
+//=================================================================================
+bool SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view> &words) const {
+    const bool is_valid = SplitIntoWords(text, words);
+    if (!stop_words_.empty()) {
+        words.erase(std::remove_if(words.begin(), words.end(), [this](const std::string_view word){ return IsStopWord(word); }),
+                    words.end());
     }
-    return words;
+    return is_valid;
 }
 
 //=================================================================================
@@ -262,16 +693,214 @@ int SearchServer::ComputeAverageRating(const std::vector<int> &ratings) {
 }
 
 //=================================================================================
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(int term_id) const {
+    return term_idfs_.Get(term_id);
+}
+
+//=================================================================================
+double SearchServer::ComputePlusWordInverseDocumentFreq(const Query &query, size_t plus_word_index, int term_id) const
+{
+    return query.plus_word_idfs.empty() ? ComputeWordInverseDocumentFreq(term_id) : query.plus_word_idfs[plus_word_index];
+}
+
+//=================================================================================
+size_t SearchServer::GetTermDocumentCount(const std::string_view word) const
+{
+    const int term_id = FindTermId(word);
+    return term_id == INVALID_TERM_ID ? 0 : terms_[term_id].document_count;
+}
+
+//=================================================================================
+int SearchServer::FindTermId(const std::string_view word) const
+{
+    const auto iter = word_to_term_id_.find(word);
+    return iter == word_to_term_id_.end() ? INVALID_TERM_ID : iter->second;
+}
+
+//=================================================================================
+int SearchServer::AddTerm(const std::string_view word)
+{
+    const int term_id = FindTermId(word);
+    if (term_id != INVALID_TERM_ID){
+        return term_id;
+    }
+    const std::string_view term = term_arena_.Store(word);
+    terms_.push_back({term, 0});
+    term_postings_.emplace_back();
+    term_idfs_.Resize(terms_.size());
+    return word_to_term_id_[term] = static_cast<int>(terms_.size()) - 1;
+}
+
+//=================================================================================
+void SearchServer::AddPosting(int term_id, int ordinal, uint32_t count, double term_freq)
+{
+    // Ordinals are handed out in increasing order, so the newest document always goes to the back
+    term_postings_[term_id].Append(ordinal, count, term_freq);
+}
+
+//=================================================================================
+void SearchServer::UpdateTermInverseDocumentFreq(int term_id)
+{
+    term_idfs_.SetTermDocumentCount(term_id, terms_[term_id].document_count);
+}
+
+//=================================================================================
+void SearchServer::UpdateInverseDocumentFreqs()
+{
+    term_idfs_.SetDocumentCount(document_id_to_ordinal_.size());
+}
+
+//=================================================================================
+std::vector<int> SearchServer::MarkDocumentsRemoved(const std::vector<int> &document_ids)
+{
+    ++index_epoch_;
+    std::vector<int> term_ids;
+    for (const int document_id : document_ids){
+        const auto iter = document_id_to_ordinal_.find(document_id);
+        if (iter == document_id_to_ordinal_.end()){
+            continue;
+        }
+        const int ordinal = iter->second;
+        removed_ordinals_[ordinal] = true;
+        status_ordinals_[static_cast<size_t>(document_statuses_[ordinal])].Remove(ordinal);
+
+        for (const int term_id : document_term_ids_[ordinal]){
+            --terms_[term_id].document_count;
+            UpdateTermInverseDocumentFreq(term_id);
+            term_ids.push_back(term_id);
+        }
+
+        std::vector<int>().swap(document_term_ids_[ordinal]);
+        std::vector<uint32_t>().swap(document_term_counts_[ordinal]);
+        word_frequency_cache_.ordinal_to_word_freqs.erase(ordinal);
+        ordinal_to_document_id_[ordinal] = INVALID_DOCUMENT_ID;
+        document_id_to_ordinal_.erase(iter);
+        live_document_ids_.Erase(document_id);
+        ++removed_live_ordinal_count_;
+    }
+
+    // The removed ordinals are dropped from the live list once they make a large share of it,
+    // so removing a document does not shift the list every time
+    if (removed_live_ordinal_count_ > live_ordinals_.size() * MAX_REMOVED_LIVE_ORDINALS_SHARE){
+        CompactLiveOrdinals();
+    }
+    UpdateInverseDocumentFreqs();
+
+    std::sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    term_ids.erase(std::remove_if(term_ids.begin(), term_ids.end(), [this](int term_id){
+                       const size_t posting_count = term_postings_[term_id].size();
+                       const size_t removed_count = posting_count - terms_[term_id].document_count;
+                       return removed_count < posting_count * MAX_REMOVED_POSTINGS_SHARE;
+                   }), term_ids.end());
+    return term_ids;
+}
+
+//=================================================================================
+void SearchServer::CompactLiveOrdinals()
+{
+    live_ordinals_.erase(std::remove_if(live_ordinals_.begin(), live_ordinals_.end(), [this](int ordinal){
+                             return removed_ordinals_[ordinal];
+                         }), live_ordinals_.end());
+    removed_live_ordinal_count_ = 0;
+}
+
+//=================================================================================
+void SearchServer::CompactPostings(int term_id)
+{
+    term_postings_[term_id].Compact(removed_ordinals_, inv_word_counts_);
+}
+
+//=================================================================================
+bool SearchServer::IsOrdinalCompactionDue() const
+{
+    const size_t removed_count = ordinal_to_document_id_.size() - document_id_to_ordinal_.size();
+    return removed_count > ordinal_to_document_id_.size() * MAX_REMOVED_ORDINALS_SHARE;
+}
+
+//=================================================================================
+std::vector<int> SearchServer::CompactOrdinals()
+{
+    // New ordinals are never greater than the old ones, so every column is compacted in place
+    const size_t ordinal_count = ordinal_to_document_id_.size();
+    std::vector<int> new_ordinals(ordinal_count, INVALID_ORDINAL);
+    int live_count = 0;
+    for (size_t ordinal = 0; ordinal < ordinal_count; ++ordinal){
+        if (removed_ordinals_[ordinal]){
+            continue;
+        }
+        const int new_ordinal = live_count++;
+        new_ordinals[ordinal] = new_ordinal;
+        ordinal_to_document_id_[new_ordinal] = ordinal_to_document_id_[ordinal];
+        inv_word_counts_[new_ordinal] = inv_word_counts_[ordinal];
+        document_statuses_[new_ordinal] = document_statuses_[ordinal];
+        document_ratings_[new_ordinal] = document_ratings_[ordinal];
+        // Terms of removed documents are already released, the swap leaves an empty vector behind
+        document_term_ids_[new_ordinal].swap(document_term_ids_[ordinal]);
+        document_term_counts_[new_ordinal].swap(document_term_counts_[ordinal]);
+    }
+
+    ordinal_to_document_id_.resize(live_count);
+    ordinal_to_document_id_.shrink_to_fit();
+    inv_word_counts_.resize(live_count);
+    inv_word_counts_.shrink_to_fit();
+    document_statuses_.resize(live_count);
+    document_statuses_.shrink_to_fit();
+    document_ratings_.resize(live_count);
+    document_ratings_.shrink_to_fit();
+    document_term_ids_.resize(live_count);
+    document_term_ids_.shrink_to_fit();
+    document_term_counts_.resize(live_count);
+    document_term_counts_.shrink_to_fit();
+    std::vector<bool>(live_count, false).swap(removed_ordinals_);
+
+    for (auto& [document_id, ordinal] : document_id_to_ordinal_){
+        ordinal = new_ordinals[ordinal];
+    }
+    for (DocumentBitmap& ordinals : status_ordinals_){
+        ordinals = DocumentBitmap();
+    }
+    for (int ordinal = 0; ordinal < live_count; ++ordinal){
+        status_ordinals_[static_cast<size_t>(document_statuses_[ordinal])].Add(ordinal);
+    }
+    live_ordinals_.resize(live_count);
+    live_ordinals_.shrink_to_fit();
+    std::iota(live_ordinals_.begin(), live_ordinals_.end(), 0);
+    removed_live_ordinal_count_ = 0;
+
+    // Cached maps are moved to their new keys by node, so the maps returned by GetWordFrequencies stay in place
+    auto& ordinal_to_word_freqs = word_frequency_cache_.ordinal_to_word_freqs;
+    std::unordered_map<int, std::map<std::string_view, double>> renumbered_word_freqs;
+    renumbered_word_freqs.reserve(ordinal_to_word_freqs.size());
+    while (!ordinal_to_word_freqs.empty()){
+        auto node = ordinal_to_word_freqs.extract(ordinal_to_word_freqs.begin());
+        node.key() = new_ordinals[node.key()];
+        renumbered_word_freqs.insert(std::move(node));
+    }
+    ordinal_to_word_freqs = std::move(renumbered_word_freqs);
+
+    return new_ordinals;
 }
 
 //=================================================================================
 SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const {
     Query query;
+    std::vector<std::string_view> words;
+    ParseQuery(text, query, words);
+    return query;
+}
 
-    for (const std::string_view word : SplitIntoWords(text)) {
-        const QueryWord query_word = ParseQueryWord(word);
+//=================================================================================
+void SearchServer::ParseQuery(const std::string_view text, Query &query, std::vector<std::string_view> &words) const
+{
+    query.plus_words.clear();
+    query.minus_words.clear();
+    query.plus_word_idfs.clear();
+
+    // Only a query with special symbols needs the per-word check, it finds the word to report
+    const bool has_special_symbols = !SplitIntoWords(text, words);
+    for (const std::string_view word : words) {
+        const QueryWord query_word = ParseQueryWord(word, has_special_symbols);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 query.minus_words.push_back(query_word.data);
@@ -280,8 +909,6 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const
             }
         }
     }
-
-    return query;
 }
 
 //=================================================================================
@@ -294,7 +921,133 @@ void SearchServer::SortQuery(Query &query) const
 }
 
 //=================================================================================
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const{
+void SearchServer::ComputeRelevance(const Query &query, const DocumentFilter &filter, RelevanceAccumulator &accumulator) const
+{
+    accumulator.Reset(ordinal_to_document_id_.size(), filter);
+
+    for (size_t word_index = 0; word_index < query.plus_words.size(); ++word_index) {
+        const int term_id = FindTermId(query.plus_words[word_index]);
+        if (term_id == INVALID_TERM_ID || terms_[term_id].document_count == 0) {
+            continue;
+        }
+        const PostingList& postings = term_postings_[term_id];
+        const double inverse_document_freq = ComputePlusWordInverseDocumentFreq(query, word_index, term_id);
+        const double* inv_word_counts = inv_word_counts_.data();
+        std::array<int, POSTING_BLOCK_SIZE> ordinals;
+        std::array<uint32_t, POSTING_BLOCK_SIZE> counts;
+        for (size_t block = 0; block < postings.GetBlockCount(); ++block) {
+            const size_t count = postings.DecodeBlock(block, ordinals.data(), counts.data());
+            for (size_t i = 0; i < count; ++i) {
+                accumulator.Add(ordinals[i], ComputeTermFreq(counts[i], inv_word_counts[ordinals[i]]) * inverse_document_freq);
+            }
+        }
+    }
+}
+
+//=================================================================================
+void SearchServer::CollectMinusWordOrdinals(const Query &query, DocumentBitmap &ordinals) const
+{
+    ordinals.Clear();
+
+    for (std::string_view word : query.minus_words) {
+        const int term_id = FindTermId(word);
+        if (term_id == INVALID_TERM_ID) {
+            continue;
+        }
+        const PostingList& postings = term_postings_[term_id];
+        std::array<int, POSTING_BLOCK_SIZE> block_ordinals;
+        for (size_t block = 0; block < postings.GetBlockCount(); ++block) {
+            const size_t count = postings.DecodeBlock(block, block_ordinals.data(), nullptr);
+            ordinals.Add(block_ordinals.data(), count);
+        }
+    }
+}
+
+//=================================================================================
+DocumentFilter SearchServer::MakeDocumentFilter(const SearchFilter &search_filter, const DocumentBitmap &minus_word_ordinals, DocumentBitmap &allowed_ordinals) const
+{
+    DocumentFilter filter;
+    filter.excluded = minus_word_ordinals.empty() ? nullptr : &minus_word_ordinals;
+
+    // The allow-list is short: its documents are checked here, and only their bitmap is left for scoring
+    if (const std::vector<int>* allowed_ids = search_filter.GetAllowedIds()){
+        allowed_ordinals.Clear();
+        for (const int document_id : *allowed_ids){
+            const auto iter = document_id_to_ordinal_.find(document_id);
+            if (iter != document_id_to_ordinal_.end()
+                    && search_filter(document_id, document_statuses_[iter->second], document_ratings_[iter->second])){
+                allowed_ordinals.Add(iter->second);
+            }
+        }
+        filter.allowed = &allowed_ordinals;
+        return filter;
+    }
+
+    // No condition is needed if every live document has an accepted status. A single status has a bitmap
+    // of its own, other sets of statuses are checked in the column
+    size_t accepted_document_count = 0;
+    size_t accepted_status_count = 0;
+    size_t accepted_status = 0;
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status){
+        if (search_filter.AcceptsStatus(static_cast<DocumentStatus>(status))){
+            accepted_document_count += status_ordinals_[status].size();
+            ++accepted_status_count;
+            accepted_status = status;
+        }
+    }
+    if (accepted_document_count < document_id_to_ordinal_.size()){
+        if (accepted_status_count == 1){
+            filter.allowed = &status_ordinals_[accepted_status];
+        } else {
+            filter.statuses = document_statuses_.data();
+            filter.status_mask = search_filter.GetStatusMask();
+        }
+    }
+
+    if (search_filter.GetMinRating() != std::numeric_limits<int>::min() || search_filter.GetMaxRating() != std::numeric_limits<int>::max()){
+        filter.ratings = document_ratings_.data();
+        filter.min_rating = search_filter.GetMinRating();
+        filter.max_rating = search_filter.GetMaxRating();
+    }
+    if (search_filter.GetMinId() != std::numeric_limits<int>::min() || search_filter.GetMaxId() != std::numeric_limits<int>::max()){
+        filter.document_ids = ordinal_to_document_id_.data();
+        filter.min_id = search_filter.GetMinId();
+        filter.max_id = search_filter.GetMaxId();
+    }
+    return filter;
+}
+
+//=================================================================================
+void SearchServer::SetUpTermCursors(const Query &query, SearchContext &context) const
+{
+    std::vector<TermCursor>& cursors = context.cursors_;
+    cursors.clear();
+    for (size_t word_index = 0; word_index < query.plus_words.size(); ++word_index) {
+        const int term_id = FindTermId(query.plus_words[word_index]);
+        if (term_id == INVALID_TERM_ID || terms_[term_id].document_count == 0) {
+            continue;
+        }
+        cursors.emplace_back(term_postings_[term_id], inv_word_counts_, ComputePlusWordInverseDocumentFreq(query, word_index, term_id));
+    }
+
+    std::vector<size_t>& order = context.cursor_order_;
+    order.resize(cursors.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&cursors](size_t lhs, size_t rhs){
+        return cursors[lhs].GetMaxScore() < cursors[rhs].GetMaxScore();
+    });
+
+    std::vector<double>& prefix_sums = context.max_score_prefix_sums_;
+    prefix_sums.resize(order.size());
+    double sum = 0.;
+    for (size_t i = 0; i < order.size(); ++i){
+        sum += cursors[order[i]].GetMaxScore();
+        prefix_sums[i] = sum;
+    }
+}
+
+//=================================================================================
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text, bool check_special_symbols) const{
     bool is_minus = false;
     // Word shouldn't be empty
     if (text[0] == '-') {
@@ -302,47 +1055,239 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
         text = text.substr(1);
     }
 
-    CheckWord(text);
+    CheckWord(text, check_special_symbols);
 
     return {text, is_minus, IsStopWord(text)};
 }
 
 //=================================================================================
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int> &ratings) {
+    METRIC_DURATION("search_server.add_document");
     if (!IsValidDocumentId(document_id)){
         throw std::invalid_argument("negative document id: " + std::to_string(document_id));
     }
     if (!IsUniqueDocumentId(document_id)){
         throw std::invalid_argument("document id is exist: " + std::to_string(document_id));
     }
-    if (IsContainSpecialSymbols(document)){
+    if (!IsValidDocumentStatus(status)){
+        throw std::invalid_argument("invalid document status");
+    }
+    CheckOrdinalCount(1);
+    std::vector<std::string_view> words;
+    if (!SplitIntoWordsNoStop(document, words)){
         throw std::invalid_argument("document contaion special symbols");
     }
 
-    const auto words = SplitIntoWordsNoStop(document);
-    std::vector<std::string> document_words(words.size());
+    ++index_epoch_;
+    const int ordinal = static_cast<int>(ordinal_to_document_id_.size());
+    ordinal_to_document_id_.push_back(document_id);
+    document_id_to_ordinal_.emplace(document_id, ordinal);
+    removed_ordinals_.push_back(false);
+    status_ordinals_[static_cast<size_t>(status)].Add(ordinal);
+    document_statuses_.push_back(status);
+    const int rating = ComputeAverageRating(ratings);
+    document_ratings_.push_back(rating);
+    const double inv_word_count = 1.0 / words.size();
+    inv_word_counts_.push_back(inv_word_count);
+
+    std::vector<int> term_ids;
+    term_ids.reserve(words.size());
+    for (const std::string_view word : words) {
+        term_ids.push_back(AddTerm(word));
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+
+    // Equal term ids are adjacent, every run is one posting
+    auto &term_counts = document_term_counts_.emplace_back();
+    for (auto run = term_ids.begin(); run != term_ids.end();) {
+        const auto run_end = std::upper_bound(run, term_ids.end(), *run);
+        const uint32_t count = static_cast<uint32_t>(run_end - run);
+        const double term_freq = ComputeTermFreq(count, inv_word_count);
+        AddPosting(*run, ordinal, count, term_freq);
+        term_counts.push_back(count);
+        ++terms_[*run].document_count;
+        UpdateTermInverseDocumentFreq(*run);
+        run = run_end;
+    }
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+    document_term_ids_.push_back(std::move(term_ids));
+
+    live_ordinals_.push_back(ordinal);
+    live_document_ids_.Insert(document_id);
+    UpdateInverseDocumentFreqs();
+}
+
+//=================================================================================
+void SearchServer::AddDocuments(const std::vector<RawDocument> &documents)
+{
+    METRIC_DURATION("search_server.add_documents");
+    std::unordered_set<int> batch_ids;
+    for (const RawDocument& document : documents){
+        if (!IsValidDocumentId(document.id)){
+            throw std::invalid_argument("negative document id: " + std::to_string(document.id));
+        }
+        if (!IsUniqueDocumentId(document.id) || !batch_ids.insert(document.id).second){
+            throw std::invalid_argument("document id is exist: " + std::to_string(document.id));
+        }
+        if (!IsValidDocumentStatus(document.status)){
+            throw std::invalid_argument("invalid document status");
+        }
+    }
+    CheckOrdinalCount(documents.size());
+
+    std::vector<size_t> indexes(documents.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+
+    // Distinct words of every document with their occurrence counts and frequencies; words point to their first
+    // occurrences in the source texts
+    struct WordFreq {
+        std::string_view word;
+        uint32_t count;
+        double freq;
+    };
+    struct ParsedDocument {
+        std::vector<WordFreq> word_freqs;
+        double inv_word_count = 0.;
+        bool has_special_symbols = false;
+    };
+    std::vector<ParsedDocument> parsed_documents(documents.size());
     std::transform(std::execution::par,
-                   words.begin(), words.end(),
-                   document_words.begin(),
-                   [](std::string_view word){ return std::string(word);});
-
-    document_ids_.insert(document_id);
-    documents_.emplace(document_id,
-                       DocumentData{
-                           ComputeAverageRating(ratings),
-                           status,
-                           document_words
-                           });
+                   documents.begin(), documents.end(),
+                   parsed_documents.begin(),
+                   [this](const RawDocument& document)
+    {
+        ParsedDocument parsed;
+        static thread_local std::vector<std::string_view> words;
+        if (!SplitIntoWordsNoStop(document.text, words)){
+            parsed.has_special_symbols = true;
+            return parsed;
+        }
+        parsed.inv_word_count = 1.0 / words.size();
+        std::sort(words.begin(), words.end());
+        for (const std::string_view word : words){
+            if (parsed.word_freqs.empty() || parsed.word_freqs.back().word != word){
+                parsed.word_freqs.push_back({word, 0, 0.});
+            } else if (word.data() < parsed.word_freqs.back().word.data()){
+                parsed.word_freqs.back().word = word;
+            }
+            ++parsed.word_freqs.back().count;
+        }
+        for (WordFreq& word_freq : parsed.word_freqs){
+            word_freq.freq = ComputeTermFreq(word_freq.count, parsed.inv_word_count);
+        }
+        return parsed;
+    });
+    if (std::any_of(parsed_documents.begin(), parsed_documents.end(), [](const ParsedDocument& parsed){ return parsed.has_special_symbols; })){
+        throw std::invalid_argument("document contaion special symbols");
+    }
 
-    const double inv_word_count = 1.0 / words.size();
-    for (const std::string &word : documents_.at(document_id).text) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs[document_id][word] += inv_word_count;
+    ++index_epoch_;
+
+    // Every thread indexes a contiguous range of the batch
+    const int base_ordinal = static_cast<int>(ordinal_to_document_id_.size());
+    const size_t chunk_count = std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+    // Partial postings refer to the parsed words, they are packed once merged
+    using PartialPostings = std::vector<std::pair<int, const WordFreq*>>;
+    std::vector<std::unordered_map<std::string_view, PartialPostings>> partial_indexes(chunk_count);
+    std::for_each(std::execution::par,
+                  indexes.begin(), indexes.begin() + std::min(chunk_count, indexes.size()),
+                  [&](size_t chunk)
+    {
+        auto& partial_index = partial_indexes[chunk];
+        for (size_t i = chunk * chunk_size; i < std::min(documents.size(), (chunk + 1) * chunk_size); ++i){
+            for (const WordFreq& word_freq : parsed_documents[i].word_freqs){
+                partial_index[word_freq.word].emplace_back(base_ordinal + static_cast<int>(i), &word_freq);
+            }
+        }
+    });
+
+    // Merge: term ids are assigned in one sequential pass, then every term appends its parts in chunk order,
+    // which keeps the ordinals sorted. New words get their ids in the order they first occur in the batch,
+    // as with a loop of AddDocument, so the index does not depend on the number of threads
+    std::vector<const PartialPostings*> ordered_parts;
+    for (const auto& partial_index : partial_indexes){
+        for (const auto& [word, postings] : partial_index){
+            ordered_parts.push_back(&postings);
+        }
+    }
+    std::sort(ordered_parts.begin(), ordered_parts.end(), [](const PartialPostings* lhs, const PartialPostings* rhs){
+        const auto& [lhs_ordinal, lhs_word_freq] = lhs->front();
+        const auto& [rhs_ordinal, rhs_word_freq] = rhs->front();
+        return lhs_ordinal != rhs_ordinal ? lhs_ordinal < rhs_ordinal : lhs_word_freq->word.data() < rhs_word_freq->word.data();
+    });
+    std::vector<std::pair<int, const PartialPostings*>> parts;
+    parts.reserve(ordered_parts.size());
+    for (const PartialPostings* postings : ordered_parts){
+        parts.emplace_back(AddTerm(postings->front().second->word), postings);
+    }
+    std::stable_sort(parts.begin(), parts.end(), [](const auto& lhs, const auto& rhs){ return lhs.first < rhs.first; });
+    std::vector<size_t> term_starts;
+    for (size_t i = 0; i < parts.size(); ++i){
+        if (i == 0 || parts[i].first != parts[i - 1].first){
+            term_starts.push_back(i);
+        }
+    }
+    std::for_each(std::execution::par,
+                  term_starts.begin(), term_starts.end(),
+                  [this, &parts](size_t start)
+    {
+        const int term_id = parts[start].first;
+        PostingList& postings = term_postings_[term_id];
+        for (size_t i = start; i < parts.size() && parts[i].first == term_id; ++i){
+            const PartialPostings& part = *parts[i].second;
+            for (const auto& [ordinal, word_freq] : part){
+                postings.Append(ordinal, word_freq->count, word_freq->freq);
+            }
+            terms_[term_id].document_count += part.size();
+        }
+        UpdateTermInverseDocumentFreq(term_id);
+    });
+
+    // Forward index and ratings are written in parallel straight into their columns
+    const size_t ordinal_count = base_ordinal + documents.size();
+    document_term_ids_.resize(ordinal_count);
+    document_term_counts_.resize(ordinal_count);
+    document_ratings_.resize(ordinal_count);
+    std::for_each(std::execution::par,
+                  indexes.begin(), indexes.end(),
+                  [&](size_t i)
+    {
+        const int ordinal = base_ordinal + static_cast<int>(i);
+        std::vector<std::pair<int, uint32_t>> term_counts;
+        term_counts.reserve(parsed_documents[i].word_freqs.size());
+        for (const WordFreq& word_freq : parsed_documents[i].word_freqs){
+            term_counts.emplace_back(FindTermId(word_freq.word), word_freq.count);
+        }
+        std::sort(term_counts.begin(), term_counts.end());
+        std::vector<int>& term_ids = document_term_ids_[ordinal];
+        term_ids.reserve(term_counts.size());
+        document_term_counts_[ordinal].reserve(term_counts.size());
+        for (const auto& [term_id, count] : term_counts){
+            term_ids.push_back(term_id);
+            document_term_counts_[ordinal].push_back(count);
+        }
+        document_ratings_[ordinal] = ComputeAverageRating(documents[i].ratings);
+    });
+
+    for (size_t i = 0; i < documents.size(); ++i){
+        const int document_id = documents[i].id;
+        const int ordinal = base_ordinal + static_cast<int>(i);
+        ordinal_to_document_id_.push_back(document_id);
+        document_id_to_ordinal_.emplace(document_id, ordinal);
+        removed_ordinals_.push_back(false);
+        status_ordinals_[static_cast<size_t>(documents[i].status)].Add(ordinal);
+        document_statuses_.push_back(documents[i].status);
+        inv_word_counts_.push_back(parsed_documents[i].inv_word_count);
+        live_ordinals_.push_back(ordinal);
+        live_document_ids_.Insert(document_id);
     }
+    UpdateInverseDocumentFreqs();
 }
 
 //=================================================================================
 void SearchServer::SetStopWords(const std::string_view text) {
+    ++index_epoch_;
     for (const std::string_view word : SplitIntoWords(text)) {
         stop_words_.insert(std::string(word));
     }
@@ -2,6 +2,7 @@
 //=================================================================================
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <vector>
 #include <algorithm>
@@ -9,20 +10,66 @@
 #include <list>
 #include <thread>
 #include <atomic>
+#include <limits>
+#include <array>
+#include <numeric>
+#include <memory>
+#include <mutex>
 
 //=================================================================================
 #include "document.h"
 #include "string_processing.h"
 #include "log_duration.h"
+#include "metrics.h"
 #include "concurrent_map.h"
+#include "top_documents.h"
+#include "relevance_accumulator.h"
+#include "string_arena.h"
+#include "query_cache.h"
+#include "search_context.h"
+#include "posting_list.h"
+#include "document_bitmap.h"
+#include "search_filter.h"
+#include "term_idf_table.h"
+#include "document_id_index.h"
 
 //=================================================================================
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+//=================================================================================
+struct SearchOptions {
+    size_t max_result_document_count = MAX_RESULT_DOCUMENT_COUNT;
+    // Sequential search skips documents that cannot get into the result (MaxScore).
+    // The result is the same, false scores every posting
+    bool use_dynamic_pruning = true;
+};
+
+//=================================================================================
+struct PostingListStats {
+    size_t posting_count = 0;
+    // Postings of removed documents left until the list is compacted
+    size_t removed_posting_count = 0;
+};
+
 //=================================================================================
 class SearchServer {
+    // Scores the shards with corpus-wide IDF through the private query interface
+    friend class ShardedSearchServer;
+    // Parses the queries of a batch once and splits the long ones into ranges of ordinals
+    friend class BatchQueryExecutor;
+
     inline static constexpr int INVALID_DOCUMENT_ID = -1;
-    inline static constexpr double DOUBLE_CALCULATION_ERROR = 1e-6;
+    inline static constexpr int INVALID_TERM_ID = -1;
+    inline static constexpr int INVALID_ORDINAL = -1;
+    inline static constexpr size_t DOCUMENT_STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+    // The list of live ordinals is compacted once this share of it belongs to removed documents
+    inline static constexpr double MAX_REMOVED_LIVE_ORDINALS_SHARE = 0.25;
+    // All ordinals are renumbered densely once this share of them belongs to removed documents
+    inline static constexpr double MAX_REMOVED_ORDINALS_SHARE = 0.5;
+    // Ordinals scored at once by FindTopDocumentsMaxScore between revisions of the essential terms
+    inline static constexpr int MAX_SCORE_WINDOW_SIZE = 4096;
+    // Non-essential terms are skipped only if they hold this many postings per posting of the essential ones
+    inline static constexpr size_t MAX_SCORE_MIN_SKIP_RATIO = 3;
 
     struct QueryWord {
         std::string_view data;
@@ -30,20 +77,73 @@ class SearchServer {
         bool is_stop;
     };
 
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-        std::vector<std::string> text;
+    struct TermData {
+        std::string_view text;          // points into term_arena_
+        size_t document_count = 0;      // reference count: live documents containing the term
     };
 
     TransparentStringSet stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs;
 
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
+    // Every distinct term is stored once; terms are never erased, so views into the arena are always valid.
+    // The views would dangle in a copy, so the arena and with it SearchServer are move-only
+    StringArena term_arena_;
+    std::vector<TermData> terms_;                               // term id -> term
+    std::unordered_map<std::string_view, int> word_to_term_id_;
+    std::vector<PostingList> term_postings_;                    // term id -> postings
+    TermIdfTable term_idfs_;                                    // term id -> IDF
+
+    // Dense document table: documents get dense ordinals in the order they are added, and everything
+    // about a document is kept in columns indexed by its ordinal. Ordinals of removed documents are not reused,
+    // they are dropped when the ordinals are compacted, which keeps the order of the live documents
+    std::vector<int> ordinal_to_document_id_;
+    std::unordered_map<int, int> document_id_to_ordinal_;
+    std::vector<bool> removed_ordinals_;        // tombstones: queries skip these ordinals
+    // Postings keep occurrence counts, term frequencies are restored from these
+    std::vector<double> inv_word_counts_;       // ordinal -> 1 / number of words of the document
+    // Columns of document metadata that filters check before scoring
+    std::vector<DocumentStatus> document_statuses_;     // ordinal -> status
+    std::vector<int> document_ratings_;                 // ordinal -> rating
+    std::vector<std::vector<int>> document_term_ids_;   // ordinal -> distinct terms, sorted
+    std::vector<std::vector<uint32_t>> document_term_counts_;   // ordinal -> occurrences of the terms of document_term_ids_
+    std::array<DocumentBitmap, DOCUMENT_STATUS_COUNT> status_ordinals_;    // status -> ordinals of live documents
+    // Documents by increasing ordinal for the scans over all of them. Removed ordinals stay until
+    // they make MAX_REMOVED_LIVE_ORDINALS_SHARE of the list, scans skip them by removed_ordinals_
+    std::vector<int> live_ordinals_;
+    size_t removed_live_ordinal_count_ = 0;
+    DocumentIdIndex live_document_ids_;         // ids of the live documents, sorted
+
+    // Maps of GetWordFrequencies by ordinal, built on the first request for a document and dropped with it.
+    // A move takes the maps, whose nodes stay in place, and leaves the mutex of each cache with it
+    struct WordFrequencyCache {
+        WordFrequencyCache() = default;
+        WordFrequencyCache(WordFrequencyCache&& other) noexcept
+            : ordinal_to_word_freqs(std::move(other.ordinal_to_word_freqs)) {
+            other.ordinal_to_word_freqs.clear();
+        }
+        WordFrequencyCache& operator=(WordFrequencyCache&& other) noexcept {
+            if (this != &other) {
+                ordinal_to_word_freqs = std::move(other.ordinal_to_word_freqs);
+                other.ordinal_to_word_freqs.clear();
+            }
+            return *this;
+        }
+
+        std::mutex mutex;
+        std::unordered_map<int, std::map<std::string_view, double>> ordinal_to_word_freqs;
+    };
+    mutable WordFrequencyCache word_frequency_cache_;
+
+    // Incremented by every change of the index, cached results from older epochs are invalid
+    uint64_t index_epoch_ = 0;
+    std::unique_ptr<QueryResultCache> query_cache_;
 
 public:
+    // A posting list is compacted once this share of its postings belongs to removed documents
+    inline static constexpr double MAX_REMOVED_POSTINGS_SHARE = 0.25;
+    // Documents are numbered by int ordinals: live documents and removed ones not compacted yet together
+    // take at most this many. Adding documents past it throws std::length_error
+    inline static constexpr size_t MAX_ORDINAL_COUNT = std::numeric_limits<int>::max();
+
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words);
     explicit SearchServer(const std::string stop_words_text);
@@ -51,36 +151,90 @@ public:
 
     void SetStopWords(const std::string_view text);
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Tokenizes the documents in parallel, builds partial indexes per thread and merges them into the index.
+    // The whole batch is validated first: if any document is rejected, nothing is added
+    void AddDocuments(const std::vector<RawDocument>& documents);
 
     template<typename Predicate>
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, Predicate predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, Predicate predicate, const SearchOptions& options = {}) const;
     template<typename Predicate>
-    std::vector<Document> FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, Predicate predicate) const;
+    std::vector<Document> FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions& options = {}) const;
     template<typename Predicate>
-    std::vector<Document> FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, Predicate predicate) const;
+    std::vector<Document> FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions& options = {}) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+    std::vector<Document> FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+    std::vector<Document> FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
 
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
-    std::vector<Document> FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
-    std::vector<Document> FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    // The filter is checked against the document columns before scoring, the predicate overloads call back per document
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, const SearchFilter& filter, const SearchOptions& options = {}) const;
+    std::vector<Document> FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, const SearchFilter& filter, const SearchOptions& options = {}) const;
+    std::vector<Document> FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, const SearchFilter& filter, const SearchOptions& options = {}) const;
+
+    // Sequential search in the buffers of context, the returned documents stay valid until its next use.
+    // The overloads without a context use the context of the calling thread and copy the result out;
+    // the parallel ones allocate their own scratch, as other tasks may run on a thread waiting inside them
+    template<typename Predicate>
+    const std::vector<Document>& FindTopDocuments(SearchContext& context, const std::string_view raw_query, Predicate predicate, const SearchOptions& options = {}) const;
+    const std::vector<Document>& FindTopDocuments(SearchContext& context, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+    const std::vector<Document>& FindTopDocuments(SearchContext& context, const std::string_view raw_query, const SearchFilter& filter, const SearchOptions& options = {}) const;
+
+    // Results of the status-filtered FindTopDocuments are cached when capacity is not zero.
+    // Zero turns the cache off
+    void SetQueryCacheCapacity(size_t capacity);
+    QueryCacheStats GetQueryCacheStats() const;
 
     int GetDocumentCount() const;
+    // Documents are indexed by increasing id
     int GetDocumentId(int index) const;
     void RemoveDocument(int document_id);
     void RemoveDocument(std::execution::sequenced_policy& policy, int document_id);
     void RemoveDocument(std::execution::parallel_policy& policy, int document_id);
 
-    const std::map<std::string_view, double> &GetWordFrequencies(int document_id) const;
-
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    // Removes a batch of documents, compacting every affected posting list at most once.
+    // Once MAX_REMOVED_ORDINALS_SHARE of the ordinals belong to removed documents, all of them are compacted
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::execution::sequenced_policy& policy, const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::execution::parallel_policy& policy, const std::vector<int>& document_ids);
+    // Postings of the word, empty for an unknown word. Fewer than MAX_REMOVED_POSTINGS_SHARE of them are removed ones
+    PostingListStats GetPostingListStats(const std::string_view word) const;
+
+    // Documents keep no per-word maps: the map of a document is built from its term ids and counts on the first
+    // request and kept until the document is removed or a snapshot is loaded. An empty map for a missing document
+    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+
+    // Ids of the documents with the same set of words as a document with a smaller id, sorted.
+    // Documents are grouped by a 128-bit fingerprint of their term ids computed in parallel,
+    // equal fingerprints are confirmed by comparing the terms
+    std::vector<int> FindDuplicateDocuments() const;
+
+    // Binary snapshot of the whole index (stop words, terms, postings, documents), see index_snapshot.h.
+    // Loading replaces the current contents and does not tokenize anything: the mapped file is checked and its columns
+    // are copied, the hash maps are rebuilt. The snapshot.* cases of the benchmark measure it against add_document
+    void SaveSnapshot(const std::string& path) const;
+    void LoadSnapshot(const std::string& path);
+
+    // Ids of the documents in increasing order
+    std::vector<int>::const_iterator begin() const;
+    std::vector<int>::const_iterator end() const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy& policy, const std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy& policy, const std::string_view raw_query, int document_id) const;
+    // The matched words stay valid until the next use of context
+    std::tuple<const std::vector<std::string_view>&, DocumentStatus> MatchDocument(SearchContext& context, const std::string_view raw_query, int document_id) const;
+
+    // Parses the query once and matches it with every document, results are in the order of document_ids.
+    // Throws before matching anything if one of the documents does not exist
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::execution::sequenced_policy& policy, const std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(const std::execution::parallel_policy& policy, const std::string_view raw_query, const std::vector<int>& document_ids) const;
 
 private:
-    void CheckDocumentIdExistence(const int id) const;
-    void CheckWord(const std::string_view word) const;
+    // Throws if there is no such document
+    int GetDocumentOrdinal(const int id) const;
+    // The tokenizer already rejects control characters, so callers that used it may skip that check
+    void CheckWord(const std::string_view word, bool check_special_symbols = true) const;
     void CheckStopWords() const;
     bool IsStopWord(const std::string_view word) const;
     bool IsContainSpecialSymbols(const std::string_view word) const;
@@ -88,27 +242,96 @@ private:
     bool IsWordStartWithMinus(const std::string_view word) const;
     bool IsValidDocumentId(const int id) const;
     bool IsUniqueDocumentId(const int id) const;
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // Throws if added_count more ordinals would pass MAX_ORDINAL_COUNT
+    void CheckOrdinalCount(size_t added_count) const;
+    static bool IsValidDocumentStatus(DocumentStatus status);
+    // Returns false if text contains special symbols
+    bool SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
     static int ComputeAverageRating(const std::vector<int>& ratings);
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
-
-    QueryWord ParseQueryWord(std::string_view text) const;
-
-    struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
-    };
+    double ComputeWordInverseDocumentFreq(int term_id) const;
+
+    int FindTermId(const std::string_view word) const;
+    int AddTerm(const std::string_view word);
+    void AddPosting(int term_id, int ordinal, uint32_t count, double term_freq);
+    // Reports the changed document counts of terms_ and of the document table to the IDF table
+    void UpdateTermInverseDocumentFreq(int term_id);
+    void UpdateInverseDocumentFreqs();
+    // Tombstones the documents and returns ids of the terms whose posting lists need compaction
+    std::vector<int> MarkDocumentsRemoved(const std::vector<int>& document_ids);
+    void CompactLiveOrdinals();
+    void CompactPostings(int term_id);
+    bool IsOrdinalCompactionDue() const;
+    // Renumbers the live documents from 0 in the same order and drops the removed ones from the columns.
+    // Returns the new ordinal of every old one, INVALID_ORDINAL for removed ones; the posting lists are left to the caller
+    std::vector<int> CompactOrdinals();
+
+    QueryWord ParseQueryWord(std::string_view text, bool check_special_symbols) const;
+
+    using Query = ParsedQuery;
+
+    double ComputePlusWordInverseDocumentFreq(const Query& query, size_t plus_word_index, int term_id) const;
+    size_t GetTermDocumentCount(const std::string_view word) const;
 
     Query ParseQuery(const std::string_view text) const;
+    // Fills query in place, words is the buffer for the tokens
+    void ParseQuery(const std::string_view text, Query& query, std::vector<std::string_view>& words) const;
 
     void SortQuery(Query& query) const;
 
+    // Resets the accumulator and sums relevance of every document containing a plus word that the filter accepts
+    void ComputeRelevance(const Query& query, const DocumentFilter& filter, RelevanceAccumulator& accumulator) const;
+    // Union of the postings of the minus words; the same for sequential and parallel searches
+    void CollectMinusWordOrdinals(const Query& query, DocumentBitmap& ordinals) const;
+    // Documents without minus words. A SearchFilter is translated into conditions on the columns,
+    // allowed_ordinals is filled with the documents of its allow-list
+    template<typename Predicate>
+    DocumentFilter MakeDocumentFilter(const Predicate& predicate, const DocumentBitmap& minus_word_ordinals, DocumentBitmap& allowed_ordinals) const;
+    DocumentFilter MakeDocumentFilter(const SearchFilter& search_filter, const DocumentBitmap& minus_word_ordinals, DocumentBitmap& allowed_ordinals) const;
+    // The part of the predicate still checked per scored document: nothing is left of a SearchFilter
+    template<typename Predicate>
+    static const Predicate& GetResidualPredicate(const Predicate& predicate);
+    static auto GetResidualPredicate(const SearchFilter&);
+    // Sorted distinct term ids of the query words; words that are not in the index match nothing
+    void FindQueryTermIds(const Query& query, std::vector<int>& plus_term_ids, std::vector<int>& minus_term_ids) const;
+    // Intersects the sorted term ids with the terms of the document, fills matched_words sorted by text.
+    // Every query term is sought from the position of the previous one, so it is O(query * log(document))
+    void MatchDocumentTerms(int ordinal, const std::vector<int>& plus_term_ids, const std::vector<int>& minus_term_ids,
+                            std::vector<std::string_view>& matched_words) const;
+    template<typename ExecutionPolicy>
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocumentsImpl(const ExecutionPolicy& policy, const std::string_view raw_query, const std::vector<int>& document_ids) const;
+    // Cursors over the postings of the plus words with their score bounds
+    void SetUpTermCursors(const Query& query, SearchContext& context) const;
+
+    // Selects into context.documents_
+    template<typename Predicate>
+    void SelectTopDocuments(const Query& query, Predicate predicate, const SearchOptions& options, SearchContext& context) const;
+    template<typename Predicate>
+    std::vector<Document> SelectTopDocuments(const std::execution::sequenced_policy&, const Query& query, Predicate predicate, const SearchOptions& options) const;
+    // Same with MaxScore over the documents with ordinals in [ordinal_begin, ordinal_end) only.
+    // Merging the results over ranges that cover all ordinals gives the result of the whole query
+    template<typename Predicate>
+    void SelectTopDocumentsInRange(const Query& query, Predicate predicate, const SearchOptions& options, SearchContext& context,
+                                   int ordinal_begin, int ordinal_end) const;
+    template<typename Predicate>
+    std::vector<Document> SelectTopDocuments(const std::execution::parallel_policy&, const Query& query, Predicate predicate, const SearchOptions& options) const;
+
+    // Takes documents from the result cache, select_documents(documents) fills them on a miss
+    template<typename SelectDocuments>
+    void SelectCachedTopDocuments(const Query& query, DocumentStatus status, const SearchOptions& options,
+                                  std::vector<Document>& documents, SelectDocuments select_documents) const;
+
+    // Matched documents are passed to top_documents, which keeps only the best of them.
+    // Documents the filter does not accept are never scored
     template<typename Predicate>
-    std::vector<Document> FindAllDocuments(const Query& query, Predicate predicate) const;
+    void FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, const DocumentFilter& filter, Predicate predicate,
+                          RelevanceAccumulator& accumulator, TopDocuments& top_documents) const;
     template<typename Predicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&, const Query& query, Predicate predicate) const;
+    void FindAllDocuments(const std::execution::parallel_policy&, const Query& query, const DocumentFilter& filter, Predicate predicate,
+                          TopDocuments& top_documents) const;
+    // MaxScore: feeds context.top_documents_ only with documents in [ordinal_begin, ordinal_end) that may get into it
     template<typename Predicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query, Predicate predicate) const;
+    void FindTopDocumentsMaxScore(const Query& query, const DocumentFilter& filter, Predicate predicate, SearchContext& context,
+                                  int ordinal_begin, int ordinal_end) const;
 };
 
 template <typename StringContainer>
@@ -118,144 +341,380 @@ inline SearchServer::SearchServer(const StringContainer& stop_words)
 }
 
 template<typename Predicate>
-inline std::vector<Document> SearchServer::FindAllDocuments(const Query& query, Predicate predicate) const {
-    return FindAllDocuments(std::execution::seq, query, predicate);
+inline DocumentFilter SearchServer::MakeDocumentFilter([[maybe_unused]] const Predicate& predicate, const DocumentBitmap& minus_word_ordinals,
+                                                       [[maybe_unused]] DocumentBitmap& allowed_ordinals) const
+{
+    DocumentFilter filter;
+    filter.excluded = minus_word_ordinals.empty() ? nullptr : &minus_word_ordinals;
+    return filter;
 }
 
 template<typename Predicate>
-inline std::vector<Document> SearchServer::FindAllDocuments(const __pstl::execution::sequenced_policy &, const Query &query, Predicate predicate) const
+inline const Predicate& SearchServer::GetResidualPredicate(const Predicate& predicate)
 {
-    std::map<int, double> document_to_relevance;
-    for (std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            document_to_relevance[document_id] += term_freq * inverse_document_freq;
-        }
-    }
+    return predicate;
+}
 
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
-    }
+inline auto SearchServer::GetResidualPredicate(const SearchFilter&)
+{
+    return []([[maybe_unused]] int document_id, [[maybe_unused]] DocumentStatus status, [[maybe_unused]] int rating) {
+        return true;
+    };
+}
+
+template<typename ExecutionPolicy>
+inline std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocumentsImpl(const ExecutionPolicy& policy, const std::string_view raw_query,
+                                                                                                             const std::vector<int>& document_ids) const
+{
+    std::vector<int> ordinals(document_ids.size());
+    std::transform(document_ids.begin(), document_ids.end(), ordinals.begin(), [this](int document_id){
+        return GetDocumentOrdinal(document_id);
+    });
+
+    const Query query = ParseQuery(raw_query);
+    std::vector<int> plus_term_ids;
+    std::vector<int> minus_term_ids;
+    FindQueryTermIds(query, plus_term_ids, minus_term_ids);
+
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> results(ordinals.size());
+    std::transform(policy, ordinals.begin(), ordinals.end(), results.begin(), [&](int ordinal){
+        std::vector<std::string_view> matched_words;
+        MatchDocumentTerms(ordinal, plus_term_ids, minus_term_ids, matched_words);
+        return std::tuple{std::move(matched_words), document_statuses_[ordinal]};
+    });
+    return results;
+}
 
-    std::vector<Document> matched_documents;
+template<typename Predicate>
+inline void SearchServer::FindAllDocuments(const __pstl::execution::sequenced_policy &, const Query &query, const DocumentFilter& filter, Predicate predicate,
+                                           RelevanceAccumulator& accumulator, TopDocuments& top_documents) const
+{
+    ComputeRelevance(query, filter, accumulator);
 
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        if (predicate(document_id, documents_.at(document_id).status, documents_.at(document_id).rating)){
-            matched_documents.push_back({
+    accumulator.ForEach([this, &predicate, &top_documents](int ordinal, double relevance) {
+        if (removed_ordinals_[ordinal] || !top_documents.MayAccept(relevance)){
+            return;
+        }
+        const int document_id = ordinal_to_document_id_[ordinal];
+        const int rating = document_ratings_[ordinal];
+        if (predicate(document_id, document_statuses_[ordinal], rating)){
+            top_documents.Add({
                 document_id,
                 relevance,
-                documents_.at(document_id).rating
+                rating
             });
         }
-    }
-    return matched_documents;
+    });
 }
 
 template<typename Predicate>
-inline std::vector<Document> SearchServer::FindAllDocuments(const __pstl::execution::parallel_policy &, const Query &query, Predicate predicate) const
+inline void SearchServer::FindAllDocuments(const __pstl::execution::parallel_policy &, const Query &query, const DocumentFilter& filter, Predicate predicate,
+                                           TopDocuments& top_documents) const
 {
-    ConcurrentMap<int, double> document_to_relevance(document_ids_.size());
+    std::vector<std::pair<int, double>> plus_term_idfs;
+    size_t posting_count = 0;
+    size_t block_count = 0;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const int term_id = FindTermId(query.plus_words[i]);
+        if (term_id != INVALID_TERM_ID && terms_[term_id].document_count > 0) {
+            plus_term_idfs.emplace_back(term_id, ComputePlusWordInverseDocumentFreq(query, i, term_id));
+            posting_count += term_postings_[term_id].size();
+            block_count = std::max(block_count, term_postings_[term_id].GetBlockCount());
+        }
+    }
+    std::vector<size_t> blocks(block_count);
+    std::iota(blocks.begin(), blocks.end(), 0);
+
+    // Every posting adds at most one key, and there are no more keys than ordinals
+    ConcurrentMap<int, double> ordinal_to_relevance(std::min(posting_count, ordinal_to_document_id_.size()));
 
     for_each(std::execution::par,
-             query.plus_words.begin(), query.plus_words.end(),
-             [&document_to_relevance, this, &predicate, &query](std::string_view word)
+             plus_term_idfs.begin(), plus_term_idfs.end(),
+             [&ordinal_to_relevance, this, &filter, &predicate, &blocks](const auto& term_idf)
     {
-        auto contain_minus = std::any_of(std::execution::par,
-                                         query.minus_words.begin(), query.minus_words.end(),
-                                         [&query, &word](const auto& minus_word)
+        const auto [term_id, inverse_document_freq] = term_idf;
+        const PostingList& postings = term_postings_[term_id];
+        std::for_each(std::execution::par,
+                      blocks.begin(), blocks.begin() + postings.GetBlockCount(),
+                      [this, &ordinal_to_relevance, &inverse_document_freq, &filter, &predicate, &postings](size_t block)
         {
-            return minus_word == word;
-        });
-
-        if (word_to_document_freqs_.count(word) && !contain_minus) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            std::for_each(std::execution::par,
-                          word_to_document_freqs_.at(word).begin(), word_to_document_freqs_.at(word).end(),
-                          [this, &document_to_relevance, &inverse_document_freq, &predicate, &query](const auto& doc_freq)
-            {
-                const auto& doc_data = documents_.at(doc_freq.first);
-                if (predicate(doc_freq.first, doc_data.status, doc_data.rating)) {
-                    document_to_relevance[doc_freq.first].ref_to_value += doc_freq.second * inverse_document_freq;
+            std::array<int, POSTING_BLOCK_SIZE> ordinals;
+            std::array<uint32_t, POSTING_BLOCK_SIZE> counts;
+            const size_t count = postings.DecodeBlock(block, ordinals.data(), counts.data());
+            for (size_t i = 0; i < count; ++i) {
+                const int ordinal = ordinals[i];
+                if (removed_ordinals_[ordinal] || !filter.Accepts(ordinal)) {
+                    continue;
                 }
-            });
-        }
+                const int document_id = ordinal_to_document_id_[ordinal];
+                if (predicate(document_id, document_statuses_[ordinal], document_ratings_[ordinal])) {
+                    ordinal_to_relevance.Add(ordinal, ComputeTermFreq(counts[i], inv_word_counts_[ordinal]) * inverse_document_freq);
+                }
+            }
+        });
     });
 
-    const std::map<int, double>& ord_map = document_to_relevance.BuildOrdinaryMap();
-    std::vector<Document> matched_documents(ord_map.size());
-    std::transform(std::execution::par,
-                   ord_map.begin(), ord_map.end(),
-                   matched_documents.begin(),
-                   [this](const auto &pair)
-    {
-        return Document(pair.first, pair.second, documents_.at(pair.first).rating);
+    ordinal_to_relevance.ForEach([this, &top_documents](int ordinal, double relevance) {
+        top_documents.Add({ordinal_to_document_id_[ordinal], relevance, document_ratings_[ordinal]});
     });
-
-    return matched_documents;
 }
 
 template<typename Predicate>
-inline std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::sequenced_policy, const std::string_view raw_query, Predicate predicate) const
+inline void SearchServer::FindTopDocumentsMaxScore(const Query& query, const DocumentFilter& filter, Predicate predicate, SearchContext& context,
+                                                   int ordinal_begin, int ordinal_end) const
 {
-    Query query = ParseQuery(raw_query);
+    RelevanceAccumulator& accumulator = context.accumulator_;
+    TopDocuments& top_documents = context.top_documents_;
+    accumulator.Reset(ordinal_to_document_id_.size(), filter);
+    SetUpTermCursors(query, context);
+    if (ordinal_begin > 0) {
+        for (TermCursor& cursor : context.cursors_) {
+            cursor.SeekTo(ordinal_begin);
+        }
+    }
 
-    SortQuery(query);
+    std::vector<TermCursor>& cursors = context.cursors_;
+    const std::vector<size_t>& order = context.cursor_order_;
+    const std::vector<double>& prefix_sums = context.max_score_prefix_sums_;
+    std::vector<int>& window_ordinals = context.window_ordinals_;
+    std::vector<double>& window_scores = context.window_scores_;
+
+    // Terms before first_essential in order together cannot lift a document into the result,
+    // so only documents from the postings of the other (essential) terms are candidates.
+    // Essential terms are scored a window of ordinals at a time, the split is revised between windows
+    size_t first_essential = 0;
+    // Ordinals past the range end the scoring as if they were past the last document
+    const int ordinal_count = std::min(ordinal_end, static_cast<int>(ordinal_to_document_id_.size()));
+    std::array<uint64_t, MAX_SCORE_WINDOW_SIZE / 64> window_candidates;
+    while (true) {
+        int window_begin = ordinal_count;
+        for (size_t i = first_essential; i < order.size(); ++i) {
+            const TermCursor& cursor = cursors[order[i]];
+            if (!cursor.IsAtEnd()) {
+                window_begin = std::min(window_begin, cursor.GetOrdinal());
+            }
+        }
+        if (window_begin == ordinal_count) {
+            break;
+        }
+        const int window_end = window_begin + std::min(MAX_SCORE_WINDOW_SIZE, ordinal_count - window_begin);
+        // Looking up non-essential terms costs more per document than scoring,
+        // the split is only used when it skips enough of the remaining postings
+        size_t skipped_posting_count = 0;
+        size_t scored_posting_count = 0;
+        for (size_t i = 0; i < order.size(); ++i) {
+            const TermCursor& cursor = cursors[order[i]];
+            (i < first_essential ? skipped_posting_count : scored_posting_count) += cursor.GetRemainingCount();
+        }
+        const size_t window_first_essential = skipped_posting_count >= MAX_SCORE_MIN_SKIP_RATIO * scored_posting_count ? first_essential : 0;
+        const double non_essential_max_score = window_first_essential > 0 ? prefix_sums[window_first_essential - 1] : 0.;
+        for (size_t i = 0; i < order.size(); ++i) {
+            cursors[order[i]].is_essential = i >= window_first_essential;
+        }
+
+        // Essential terms are added in the order of the plus words, exactly as in ComputeRelevance.
+        // Documents before the window are already decided. With a split, the scores are kept for the final sums
+        const size_t first_scored = accumulator.GetScoredCount();
+        window_ordinals.clear();
+        window_scores.clear();
+        for (TermCursor& cursor : cursors) {
+            cursor.SeekTo(window_begin);
+            if (!cursor.is_essential) {
+                continue;
+            }
+            if (window_first_essential == 0) {
+                cursor.ScoreUntil(window_end, [&accumulator](int ordinal, double score) {
+                    accumulator.Add(ordinal, score);
+                });
+                continue;
+            }
+            cursor.window_begin = window_ordinals.size();
+            cursor.ScoreUntil(window_end, [&](int ordinal, double score) {
+                accumulator.Add(ordinal, score);
+                window_ordinals.push_back(ordinal);
+                window_scores.push_back(score);
+            });
+            cursor.window_end = window_ordinals.size();
+        }
+
+        if (window_first_essential == 0) {
+            // Every term is essential: the sums are complete, nothing to look up
+            accumulator.ForEach([&](int ordinal, double relevance) {
+                if (!removed_ordinals_[ordinal] && top_documents.MayAccept(relevance)) {
+                    const int document_id = ordinal_to_document_id_[ordinal];
+                    const int rating = document_ratings_[ordinal];
+                    if (predicate(document_id, document_statuses_[ordinal], rating)) {
+                        top_documents.Add({document_id, relevance, rating});
+                    }
+                }
+            }, first_scored);
+            while (first_essential < order.size() && !top_documents.MayAccept(prefix_sums[first_essential])) {
+                ++first_essential;
+            }
+            continue;
+        }
 
-    auto matched_documents = FindAllDocuments(std::execution::seq, query, predicate);
+        // Candidates are visited by increasing ordinal, so non-essential cursors only move forward
+        window_candidates.fill(0);
+        accumulator.ForEach([&](int ordinal, [[maybe_unused]] double relevance) {
+            const int offset = ordinal - window_begin;
+            window_candidates[offset / 64] |= uint64_t{1} << (offset % 64);
+        }, first_scored);
+
+        for (size_t word = 0; word < window_candidates.size(); ++word) {
+            for (uint64_t bits = window_candidates[word]; bits != 0; bits &= bits - 1) {
+                const int ordinal = window_begin + static_cast<int>(word * 64 + __builtin_ctzll(bits));
+                if (removed_ordinals_[ordinal]) {
+                    continue;
+                }
+                // Non-essential terms replace their bounds with actual scores, largest bounds first.
+                // The bound of the block holding the ordinal is checked before the block is decoded
+                double max_relevance = accumulator.GetRelevance(ordinal) + non_essential_max_score;
+                bool may_accept = top_documents.MayAccept(max_relevance);
+                for (size_t i = window_first_essential; may_accept && i-- > 0;) {
+                    TermCursor& cursor = cursors[order[i]];
+                    max_relevance -= cursor.GetMaxScore();
+                    cursor.SeekToBlock(ordinal);
+                    if (!cursor.IsAtEnd()) {
+                        if (!top_documents.MayAccept(max_relevance + cursor.GetBlockMaxScore())) {
+                            may_accept = false;
+                            break;
+                        }
+                        cursor.SeekTo(ordinal);
+                        if (cursor.IsAt(ordinal)) {
+                            max_relevance += cursor.GetScore();
+                        }
+                    }
+                    may_accept = top_documents.MayAccept(max_relevance);
+                }
+                if (!may_accept) {
+                    continue;
+                }
 
-    std::sort(std::execution::seq,
-              matched_documents.begin(), matched_documents.end(),
-         [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < DOUBLE_CALCULATION_ERROR) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
+                const int document_id = ordinal_to_document_id_[ordinal];
+                const int rating = document_ratings_[ordinal];
+                if (!predicate(document_id, document_statuses_[ordinal], rating)) {
+                    continue;
+                }
+                // Summed again in the order of the plus words; essential terms look in the window scores,
+                // the others were sought to the ordinal
+                double relevance = 0.;
+                for (const TermCursor& cursor : cursors) {
+                    if (!cursor.is_essential) {
+                        relevance += cursor.IsAt(ordinal) ? cursor.GetScore() : 0.;
+                        continue;
+                    }
+                    const auto begin = window_ordinals.begin() + cursor.window_begin;
+                    const auto end = window_ordinals.begin() + cursor.window_end;
+                    const auto posting = std::lower_bound(begin, end, ordinal);
+                    if (posting != end && *posting == ordinal) {
+                        relevance += window_scores[posting - window_ordinals.begin()];
+                    }
+                }
+                top_documents.Add({document_id, relevance, rating});
+                while (first_essential < order.size() && !top_documents.MayAccept(prefix_sums[first_essential])) {
+                    ++first_essential;
+                }
             }
-         });
+        }
+    }
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template<typename Predicate>
+inline void SearchServer::SelectTopDocuments(const Query& query, Predicate predicate, const SearchOptions& options, SearchContext& context) const
+{
+    context.top_documents_.Reset(options.max_result_document_count);
+    CollectMinusWordOrdinals(query, context.minus_word_ordinals_);
+    const DocumentFilter filter = MakeDocumentFilter(predicate, context.minus_word_ordinals_, context.allowed_ordinals_);
+    if (options.use_dynamic_pruning){
+        FindTopDocumentsMaxScore(query, filter, GetResidualPredicate(predicate), context, 0, static_cast<int>(ordinal_to_document_id_.size()));
+    } else {
+        FindAllDocuments(std::execution::seq, query, filter, GetResidualPredicate(predicate), context.accumulator_, context.top_documents_);
     }
+    context.top_documents_.ExtractTo(context.documents_);
+}
 
-    return matched_documents;
+template<typename Predicate>
+inline void SearchServer::SelectTopDocumentsInRange(const Query& query, Predicate predicate, const SearchOptions& options, SearchContext& context,
+                                                    int ordinal_begin, int ordinal_end) const
+{
+    context.top_documents_.Reset(options.max_result_document_count);
+    CollectMinusWordOrdinals(query, context.minus_word_ordinals_);
+    const DocumentFilter filter = MakeDocumentFilter(predicate, context.minus_word_ordinals_, context.allowed_ordinals_);
+    FindTopDocumentsMaxScore(query, filter, GetResidualPredicate(predicate), context, ordinal_begin, ordinal_end);
+    context.top_documents_.ExtractTo(context.documents_);
 }
 
 template<typename Predicate>
-inline std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::parallel_policy, const std::string_view raw_query, Predicate predicate) const
+inline std::vector<Document> SearchServer::SelectTopDocuments(const __pstl::execution::sequenced_policy&, const Query& query, Predicate predicate, const SearchOptions& options) const
 {
-    Query query = ParseQuery(raw_query);
+    SearchContext& context = SearchContext::ForCurrentThread();
+    SelectTopDocuments(query, predicate, options, context);
 
-    SortQuery(query);
+    return context.documents_;
+}
 
-    auto matched_documents = FindAllDocuments(std::execution::par, query, predicate);
+template<typename Predicate>
+inline std::vector<Document> SearchServer::SelectTopDocuments(const __pstl::execution::parallel_policy&, const Query& query, Predicate predicate, const SearchOptions& options) const
+{
+    DocumentBitmap minus_word_ordinals;
+    CollectMinusWordOrdinals(query, minus_word_ordinals);
+    DocumentBitmap allowed_ordinals;
+    const DocumentFilter filter = MakeDocumentFilter(predicate, minus_word_ordinals, allowed_ordinals);
+    TopDocuments top_documents(options.max_result_document_count);
+    FindAllDocuments(std::execution::par, query, filter, GetResidualPredicate(predicate), top_documents);
+
+    return top_documents.Extract();
+}
 
-    std::sort(std::execution::par,
-              matched_documents.begin(), matched_documents.end(),
-              [](const Document& lhs, const Document& rhs)
-    {
-        if (std::abs(lhs.relevance - rhs.relevance) < DOUBLE_CALCULATION_ERROR) {
-            return lhs.rating > rhs.rating;
-        } else {
-            return lhs.relevance > rhs.relevance;
-        }
-    });
+template<typename SelectDocuments>
+inline void SearchServer::SelectCachedTopDocuments(const Query& query, DocumentStatus status, const SearchOptions& options,
+                                                   std::vector<Document>& documents, SelectDocuments select_documents) const
+{
+    if (!query_cache_){
+        select_documents(documents);
+        return;
+    }
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    const std::string key = QueryResultCache::MakeKey(query.plus_words, query.minus_words, status, options.max_result_document_count);
+    if (auto cached = query_cache_->Find(key, index_epoch_)){
+        documents = std::move(*cached);
+        return;
     }
+    select_documents(documents);
+    query_cache_->Insert(key, index_epoch_, documents);
+}
+
+template<typename Predicate>
+inline const std::vector<Document>& SearchServer::FindTopDocuments(SearchContext& context, const std::string_view raw_query, Predicate predicate, const SearchOptions& options) const
+{
+    METRIC_DURATION("search_server.find_top_documents");
+    ParseQuery(raw_query, context.query_, context.words_);
+
+    SortQuery(context.query_);
+
+    SelectTopDocuments(context.query_, predicate, options, context);
+    return context.documents_;
+}
+
+template<typename Predicate>
+inline std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::sequenced_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions& options) const
+{
+    return FindTopDocuments(SearchContext::ForCurrentThread(), raw_query, predicate, options);
+}
+
+template<typename Predicate>
+inline std::vector<Document> SearchServer::FindTopDocuments(__pstl::execution::parallel_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions& options) const
+{
+    METRIC_DURATION("search_server.find_top_documents.par");
+    Query query = ParseQuery(raw_query);
+
+    SortQuery(query);
 
-    return matched_documents;
+    return SelectTopDocuments(std::execution::par, query, predicate, options);
 }
 
 template<typename Predicate>
-inline std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, Predicate predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, predicate);
+inline std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, Predicate predicate, const SearchOptions& options) const {
+    return FindTopDocuments(std::execution::seq, raw_query, predicate, options);
 }
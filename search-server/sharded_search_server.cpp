@@ -0,0 +1,163 @@
+#include "sharded_search_server.h"
+#include "term_idf_table.h"
+
+//=================================================================================
+#include <numeric>
+#include <unordered_set>
+
+//=================================================================================
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const std::string_view stop_words_text)
+    : ShardedSearchServer(shard_count, SplitIntoWords(stop_words_text)) {}
+
+//=================================================================================
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const std::string stop_words_text)
+    : ShardedSearchServer(shard_count, std::string_view(stop_words_text)) {}
+
+//=================================================================================
+void ShardedSearchServer::SetStopWords(const std::string_view text)
+{
+    for (SearchServer& shard : shards_){
+        shard.SetStopWords(text);
+    }
+}
+
+//=================================================================================
+void ShardedSearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int> &ratings)
+{
+    shards_[GetShardIndex(document_id)].AddDocument(document_id, document, status, ratings);
+}
+
+//=================================================================================
+void ShardedSearchServer::AddDocuments(const std::vector<RawDocument> &documents)
+{
+    // Everything a shard could reject is checked here: an exception inside the parallel part would terminate
+    const SearchServer& any_shard = shards_.front();
+    std::unordered_set<int> batch_ids;
+    for (const RawDocument& document : documents){
+        if (!any_shard.IsValidDocumentId(document.id)){
+            throw std::invalid_argument("negative document id: " + std::to_string(document.id));
+        }
+        if (!shards_[GetShardIndex(document.id)].IsUniqueDocumentId(document.id) || !batch_ids.insert(document.id).second){
+            throw std::invalid_argument("document id is exist: " + std::to_string(document.id));
+        }
+        if (!SearchServer::IsValidDocumentStatus(document.status)){
+            throw std::invalid_argument("invalid document status");
+        }
+        if (any_shard.IsContainSpecialSymbols(document.text)){
+            throw std::invalid_argument("document contaion special symbols");
+        }
+    }
+
+    std::vector<std::vector<RawDocument>> shard_documents(shards_.size());
+    for (const RawDocument& document : documents){
+        shard_documents[GetShardIndex(document.id)].push_back(document);
+    }
+
+    std::vector<size_t> shard_indexes(shards_.size());
+    std::iota(shard_indexes.begin(), shard_indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  shard_indexes.begin(), shard_indexes.end(),
+                  [this, &shard_documents](size_t index)
+    {
+        shards_[index].AddDocuments(shard_documents[index]);
+    });
+}
+
+//=================================================================================
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status, const SearchOptions &options) const
+{
+    return FindTopDocuments(raw_query, SearchFilter(status), options);
+}
+
+//=================================================================================
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, DocumentStatus status, const SearchOptions &options) const
+{
+    return FindTopDocuments(std::execution::par, raw_query, SearchFilter(status), options);
+}
+
+//=================================================================================
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, DocumentStatus status, const SearchOptions &options) const
+{
+    return FindTopDocuments(std::execution::seq, raw_query, SearchFilter(status), options);
+}
+
+//=================================================================================
+int ShardedSearchServer::GetDocumentCount() const
+{
+    int count = 0;
+    for (const SearchServer& shard : shards_){
+        count += shard.GetDocumentCount();
+    }
+    return count;
+}
+
+//=================================================================================
+size_t ShardedSearchServer::GetShardCount() const
+{
+    return shards_.size();
+}
+
+//=================================================================================
+void ShardedSearchServer::RemoveDocument(int document_id)
+{
+    shards_[GetShardIndex(document_id)].RemoveDocument(document_id);
+}
+
+//=================================================================================
+void ShardedSearchServer::RemoveDocument(std::execution::sequenced_policy &policy, int document_id)
+{
+    shards_[GetShardIndex(document_id)].RemoveDocument(policy, document_id);
+}
+
+//=================================================================================
+void ShardedSearchServer::RemoveDocument(std::execution::parallel_policy &policy, int document_id)
+{
+    shards_[GetShardIndex(document_id)].RemoveDocument(policy, document_id);
+}
+
+//=================================================================================
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const std::string_view raw_query, int document_id) const
+{
+    return shards_[GetShardIndex(document_id)].MatchDocument(raw_query, document_id);
+}
+
+//=================================================================================
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const std::execution::sequenced_policy &policy, const std::string_view raw_query, int document_id) const
+{
+    return shards_[GetShardIndex(document_id)].MatchDocument(policy, raw_query, document_id);
+}
+
+//=================================================================================
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(const std::execution::parallel_policy &policy, const std::string_view raw_query, int document_id) const
+{
+    return shards_[GetShardIndex(document_id)].MatchDocument(policy, raw_query, document_id);
+}
+
+//=================================================================================
+size_t ShardedSearchServer::GetShardIndex(int document_id) const
+{
+    // Negative ids still get a shard, which then rejects them
+    return static_cast<size_t>(static_cast<unsigned int>(document_id)) % shards_.size();
+}
+
+//=================================================================================
+SearchServer::Query ShardedSearchServer::ParseQuery(const std::string_view raw_query) const
+{
+    // All shards have the same stop words
+    const SearchServer& any_shard = shards_.front();
+    SearchServer::Query query = any_shard.ParseQuery(raw_query);
+    any_shard.SortQuery(query);
+
+    const int document_count = GetDocumentCount();
+    query.plus_word_idfs.reserve(query.plus_words.size());
+    for (const std::string_view word : query.plus_words){
+        size_t word_document_count = 0;
+        for (const SearchServer& shard : shards_){
+            word_document_count += shard.GetTermDocumentCount(word);
+        }
+        // A word without documents is skipped by every shard, its IDF is never used. The IDF is computed as
+        // a single server computes it, so the sequential scores are the same bit for bit
+        query.plus_word_idfs.push_back(TermIdfTable::ComputeInverseDocumentFreq(document_count, word_document_count));
+    }
+    return query;
+}
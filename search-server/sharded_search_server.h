@@ -0,0 +1,123 @@
+#pragma once
+
+//=================================================================================
+#include <execution>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+//=================================================================================
+#include "search_server.h"
+
+//=================================================================================
+// Search server split into independent SearchServer shards; a document goes to shard id % shard_count.
+// Queries are scattered to all shards and their top documents are merged. The shards are scored with
+// IDF computed from the document counts of the whole corpus, so relevance is the same as in one SearchServer.
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(size_t shard_count, const StringContainer& stop_words);
+    ShardedSearchServer(size_t shard_count, const std::string stop_words_text);
+    ShardedSearchServer(size_t shard_count, const std::string_view stop_words_text);
+
+    void SetStopWords(const std::string_view text);
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Validates the whole batch, then indexes the documents of every shard in parallel
+    void AddDocuments(const std::vector<RawDocument>& documents);
+
+    // Without a policy the shards are searched concurrently, each of them sequentially.
+    // seq searches the shards one by one, par searches them concurrently with the parallel algorithm inside
+    template<typename Predicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, Predicate predicate, const SearchOptions& options = {}) const;
+    template<typename Predicate>
+    std::vector<Document> FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions& options = {}) const;
+    template<typename Predicate>
+    std::vector<Document> FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions& options = {}) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+    std::vector<Document> FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+    std::vector<Document> FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL, const SearchOptions& options = {}) const;
+
+    int GetDocumentCount() const;
+    size_t GetShardCount() const;
+
+    void RemoveDocument(int document_id);
+    void RemoveDocument(std::execution::sequenced_policy& policy, int document_id);
+    void RemoveDocument(std::execution::parallel_policy& policy, int document_id);
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy& policy, const std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy& policy, const std::string_view raw_query, int document_id) const;
+
+private:
+    std::vector<SearchServer> shards_;
+
+    size_t GetShardIndex(int document_id) const;
+
+    // Parses the query once and fills in corpus-wide IDF of the plus words
+    SearchServer::Query ParseQuery(const std::string_view raw_query) const;
+
+    template<typename ShardsPolicy, typename ShardPolicy, typename Predicate>
+    std::vector<Document> FindTopDocumentsOnShards(const ShardsPolicy& shards_policy, const ShardPolicy& shard_policy,
+                                                   const std::string_view raw_query, Predicate predicate, const SearchOptions& options) const;
+};
+
+//=================================================================================
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(size_t shard_count, const StringContainer& stop_words)
+{
+    if (shard_count == 0){
+        throw std::invalid_argument("shard count should be positive");
+    }
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i){
+        shards_.emplace_back(stop_words);
+    }
+}
+
+//=================================================================================
+template<typename ShardsPolicy, typename ShardPolicy, typename Predicate>
+std::vector<Document> ShardedSearchServer::FindTopDocumentsOnShards(const ShardsPolicy &shards_policy, const ShardPolicy &shard_policy,
+                                                                    const std::string_view raw_query, Predicate predicate, const SearchOptions &options) const
+{
+    const SearchServer::Query query = ParseQuery(raw_query);
+
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    std::transform(shards_policy,
+                   shards_.begin(), shards_.end(),
+                   shard_documents.begin(),
+                   [&](const SearchServer& shard)
+    {
+        return shard.SelectTopDocuments(shard_policy, query, predicate, options);
+    });
+
+    TopDocuments top_documents(options.max_result_document_count);
+    for (const auto& documents : shard_documents){
+        for (const Document& document : documents){
+            top_documents.Add(document);
+        }
+    }
+    return top_documents.Extract();
+}
+
+//=================================================================================
+template<typename Predicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view raw_query, Predicate predicate, const SearchOptions &options) const
+{
+    return FindTopDocumentsOnShards(std::execution::par, std::execution::seq, raw_query, predicate, options);
+}
+
+//=================================================================================
+template<typename Predicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::execution::sequenced_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions &options) const
+{
+    return FindTopDocumentsOnShards(std::execution::seq, std::execution::seq, raw_query, predicate, options);
+}
+
+//=================================================================================
+template<typename Predicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::execution::parallel_policy, const std::string_view raw_query, Predicate predicate, const SearchOptions &options) const
+{
+    return FindTopDocumentsOnShards(std::execution::par, std::execution::par, raw_query, predicate, options);
+}
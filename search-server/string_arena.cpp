@@ -0,0 +1,43 @@
+#include "string_arena.h"
+
+//=================================================================================
+#include <algorithm>
+#include <utility>
+
+//=================================================================================
+StringArena::StringArena(StringArena &&other) noexcept
+    : blocks_(std::move(other.blocks_))
+    , block_pos_(std::exchange(other.block_pos_, nullptr))
+    , block_free_(std::exchange(other.block_free_, 0))
+{
+    other.blocks_.clear();
+}
+
+//=================================================================================
+StringArena &StringArena::operator=(StringArena &&other) noexcept
+{
+    if (this != &other){
+        blocks_ = std::move(other.blocks_);
+        other.blocks_.clear();
+        block_pos_ = std::exchange(other.block_pos_, nullptr);
+        block_free_ = std::exchange(other.block_free_, 0);
+    }
+    return *this;
+}
+
+//=================================================================================
+std::string_view StringArena::Store(const std::string_view text)
+{
+    if (text.size() > block_free_){
+        // Strings longer than a block get a block of their own
+        const size_t block_size = std::max(BLOCK_SIZE, text.size());
+        blocks_.push_back(std::make_unique<char[]>(block_size));
+        block_pos_ = blocks_.back().get();
+        block_free_ = block_size;
+    }
+    char* data = block_pos_;
+    std::copy(text.begin(), text.end(), data);
+    block_pos_ += text.size();
+    block_free_ -= text.size();
+    return {data, text.size()};
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+//=================================================================================
+#include <memory>
+#include <string_view>
+#include <vector>
+
+//=================================================================================
+// Append-only storage for strings. Stored strings are never moved or freed before the arena,
+// so the returned views stay valid for the whole lifetime of the arena.
+class StringArena {
+public:
+    StringArena() = default;
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+    // The moved-from arena is empty and starts a new block on the next Store
+    StringArena(StringArena&& other) noexcept;
+    StringArena& operator=(StringArena&& other) noexcept;
+
+    std::string_view Store(const std::string_view text);
+
+private:
+    inline static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* block_pos_ = nullptr;
+    size_t block_free_ = 0;
+};
@@ -3,24 +3,164 @@
 //=================================================================================
 #include <set>
 #include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SEARCH_SERVER_X86_SIMD
+#include <immintrin.h>
+#endif
 
 //=================================================================================
-std::vector<std::string_view> SplitIntoWords(const std::string_view text) {
-    std::vector<std::string_view> words;
+namespace {
 
-    auto s_begin = text.begin();
-    for (auto s_end = s_begin; s_end != text.end();){
-        s_end = std::find(s_begin, text.end(), ' ');
-        if (s_end == s_begin){
-            ++s_begin;
+// Adds the words ending in a block of BlockSize bytes: bit i of word_mask is set for a non-space byte at block[i].
+// word_begin is nullptr outside of a word and carries an unfinished word over to the next block
+template <int BlockSize>
+inline void AddBlockWords(const char* block, uint32_t word_mask, const char*& word_begin, std::vector<std::string_view>& words)
+{
+    const uint64_t in_word = word_begin != nullptr;
+    uint64_t boundaries = (word_mask ^ ((static_cast<uint64_t>(word_mask) << 1) | in_word)) & ((uint64_t{1} << BlockSize) - 1);
+    while (boundaries != 0){
+        const int i = __builtin_ctzll(boundaries);
+        boundaries &= boundaries - 1;
+        if ((word_mask >> i) & 1){
+            word_begin = block + i;
         } else {
-            std::string_view word(s_begin, std::distance(s_begin, s_end));
-            if (!word.empty()){
-                words.push_back(word);
+            words.emplace_back(word_begin, block + i - word_begin);
+            word_begin = nullptr;
+        }
+    }
+}
+
+//=================================================================================
+bool SplitIntoWordsScalar(const char* pos, const char* end, const char*& word_begin, std::vector<std::string_view>& words)
+{
+    bool has_control_characters = false;
+    for (; pos != end; ++pos){
+        const unsigned char c = static_cast<unsigned char>(*pos);
+        if (c == ' '){
+            if (word_begin != nullptr){
+                words.emplace_back(word_begin, pos - word_begin);
+                word_begin = nullptr;
             }
+            continue;
+        }
+        has_control_characters |= c < ' ';
+        if (word_begin == nullptr){
+            word_begin = pos;
+        }
+    }
+    return has_control_characters;
+}
+
+//=================================================================================
+#ifdef SEARCH_SERVER_X86_SIMD
+bool SplitIntoWordsSse2(const char* pos, const char* end, const char*& word_begin, std::vector<std::string_view>& words)
+{
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i max_control = _mm_set1_epi8(' ' - 1);
+    __m128i control_characters = _mm_setzero_si128();
+    for (; end - pos >= 16; pos += 16){
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        // Unsigned byte <= 0x1F
+        control_characters = _mm_or_si128(control_characters, _mm_cmpeq_epi8(_mm_max_epu8(block, max_control), max_control));
+        const uint32_t word_mask = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, spaces))) & 0xFFFFu;
+        AddBlockWords<16>(pos, word_mask, word_begin, words);
+    }
+    const bool has_control_characters = _mm_movemask_epi8(control_characters) != 0;
+    return SplitIntoWordsScalar(pos, end, word_begin, words) || has_control_characters;
+}
+
+//=================================================================================
+__attribute__((target("avx2")))
+bool SplitIntoWordsAvx2(const char* pos, const char* end, const char*& word_begin, std::vector<std::string_view>& words)
+{
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i max_control = _mm256_set1_epi8(' ' - 1);
+    __m256i control_characters = _mm256_setzero_si256();
+    for (; end - pos >= 32; pos += 32){
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        control_characters = _mm256_or_si256(control_characters, _mm256_cmpeq_epi8(_mm256_max_epu8(block, max_control), max_control));
+        const uint32_t word_mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, spaces)));
+        AddBlockWords<32>(pos, word_mask, word_begin, words);
+    }
+    const bool has_control_characters = !_mm256_testz_si256(control_characters, control_characters);
+    return SplitIntoWordsSse2(pos, end, word_begin, words) || has_control_characters;
+}
+#endif
+
+//=================================================================================
+using SplitImplementation = bool (*)(const char*, const char*, const char*&, std::vector<std::string_view>&);
+
+// nullptr if the instructions are not supported
+SplitImplementation GetSplitImplementation(SplitInstructions instructions)
+{
+    switch (instructions){
+    case SplitInstructions::SCALAR:
+        return SplitIntoWordsScalar;
+#ifdef SEARCH_SERVER_X86_SIMD
+    case SplitInstructions::SSE2:
+        return SplitIntoWordsSse2;
+    case SplitInstructions::AVX2:
+        return __builtin_cpu_supports("avx2") ? SplitIntoWordsAvx2 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+//=================================================================================
+SplitImplementation SelectSplitImplementation()
+{
+    for (const SplitInstructions instructions : {SplitInstructions::AVX2, SplitInstructions::SSE2}){
+        if (const SplitImplementation split = GetSplitImplementation(instructions)){
+            return split;
         }
-        s_begin = s_end + 1;
     }
+    return SplitIntoWordsScalar;
+}
+
+//=================================================================================
+bool SplitWith(SplitImplementation split, const std::string_view text, std::vector<std::string_view>& words)
+{
+    words.clear();
+    const char* word_begin = nullptr;
+    const bool has_control_characters = split(text.data(), text.data() + text.size(), word_begin, words);
+    if (word_begin != nullptr){
+        words.emplace_back(word_begin, text.data() + text.size() - word_begin);
+    }
+    return !has_control_characters;
+}
 
+} // namespace
+
+//=================================================================================
+std::vector<std::string_view> SplitIntoWords(const std::string_view text) {
+    std::vector<std::string_view> words;
+    SplitIntoWords(text, words);
     return words;
 }
+
+//=================================================================================
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view> &words)
+{
+    static const SplitImplementation split = SelectSplitImplementation();
+    return SplitWith(split, text, words);
+}
+
+//=================================================================================
+bool IsSupported(SplitInstructions instructions)
+{
+    return GetSplitImplementation(instructions) != nullptr;
+}
+
+//=================================================================================
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view> &words, SplitInstructions instructions)
+{
+    const SplitImplementation split = GetSplitImplementation(instructions);
+    if (split == nullptr){
+        throw std::invalid_argument("split instructions are not supported");
+    }
+    return SplitWith(split, text, words);
+}
@@ -2,11 +2,29 @@
 
 //=================================================================================
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 
 //=================================================================================
 std::vector<std::string_view> SplitIntoWords(const std::string_view text);
+// Splits text by spaces into words, the buffer is cleared first and its capacity reused.
+// Control characters (codes below the space) are found in the same pass: returns false if text contains any.
+// Uses SSE2, or AVX2 when the processor supports it
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words);
+
+// Instructions SplitIntoWords may use; the fastest supported ones are picked once
+enum class SplitInstructions {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// Whether the build and the processor support the instructions
+bool IsSupported(SplitInstructions instructions);
+// SplitIntoWords with the given instructions, to compare them with each other.
+// Throws std::invalid_argument if they are not supported
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words, SplitInstructions instructions);
 
 using TransparentStringSet = std::set<std::string, std::less<>>;
 
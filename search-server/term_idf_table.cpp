@@ -0,0 +1,19 @@
+#include "term_idf_table.h"
+
+//=================================================================================
+void TermIdfTable::Resize(size_t term_count)
+{
+    log_term_document_counts_.resize(term_count, NO_DOCUMENTS);
+}
+
+//=================================================================================
+void TermIdfTable::SetTermDocumentCount(int term_id, size_t term_document_count)
+{
+    log_term_document_counts_[term_id] = term_document_count == 0 ? NO_DOCUMENTS : std::log(static_cast<double>(term_document_count));
+}
+
+//=================================================================================
+void TermIdfTable::SetDocumentCount(size_t document_count)
+{
+    log_document_count_ = document_count == 0 ? 0. : std::log(static_cast<double>(document_count));
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+//=================================================================================
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+//=================================================================================
+// IDF of every term, log(document count / documents containing the term), kept next to the term dictionary.
+// It is stored as a difference of logarithms: the log of the document count of a term changes only with
+// that term, and the log of the document count is a single value. Every change of the counts is applied
+// exactly at the cost of one logarithm, so the values are never stale and lookups compute none
+class TermIdfTable {
+public:
+    // Updates run under the exclusive access of the index, for distinct terms they may run in parallel
+    void Resize(size_t term_count);
+    void SetTermDocumentCount(int term_id, size_t term_document_count);
+    void SetDocumentCount(size_t document_count);
+
+    // Safe to call from concurrent queries
+    double Get(int term_id) const;
+    // The IDF Get gives for these counts, bit for bit; for counts summed over several indexes
+    static double ComputeInverseDocumentFreq(size_t document_count, size_t term_document_count);
+
+private:
+    // A term without documents is never scored, it is marked with a negative value
+    inline static constexpr double NO_DOCUMENTS = -1.;
+
+    double log_document_count_ = 0.;
+    std::vector<double> log_term_document_counts_;
+};
+
+//=================================================================================
+inline double TermIdfTable::Get(int term_id) const
+{
+    const double log_term_document_count = log_term_document_counts_[term_id];
+    return log_term_document_count == NO_DOCUMENTS ? 0. : log_document_count_ - log_term_document_count;
+}
+
+//=================================================================================
+inline double TermIdfTable::ComputeInverseDocumentFreq(size_t document_count, size_t term_document_count)
+{
+    if (term_document_count == 0){
+        return 0.;
+    }
+    return std::log(static_cast<double>(document_count)) - std::log(static_cast<double>(term_document_count));
+}
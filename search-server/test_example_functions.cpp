@@ -1,5 +1,36 @@
-//#include "test_example_functions.h"
-//#include <string>
+#include "test_example_functions.h"
+#include "document_generator.h"
+#include "index_snapshot.h"
+#include "metrics.h"
+#include "posting_list.h"
+#include "document_bitmap.h"
+#include "batch_query_executor.h"
+#include "concurrent_map.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "sharded_search_server.h"
+#include "string_arena.h"
+#include "string_processing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
 
 ////=================================================================================
 //using std::string_literals::operator""s;
@@ -326,3 +357,1545 @@
 //    server.AddDocument(3, "work smart no hard"s, DocumentStatus::ACTUAL, {102,102,102});
 //    ASSERT_EQUAL(server.GetDocumentCount(), 3);
 //}
+
+//=================================================================================
+TestCorpus GenerateTestCorpus(unsigned seed, int dictionary_size, int document_count, int document_word_count,
+                              int query_count, int query_word_count, double minus_prob) {
+    mt19937 generator(seed);
+    TestCorpus corpus;
+    corpus.dictionary = GenerateDictionary(generator, dictionary_size, 8);
+    corpus.documents = GenerateQueries(generator, corpus.dictionary, document_count, document_word_count);
+    corpus.queries = GenerateQueries(generator, corpus.dictionary, query_count, query_word_count, minus_prob);
+    return corpus;
+}
+
+//=================================================================================
+RawDocument MakeTestDocument(const TestCorpus& corpus, size_t index, int id_step) {
+    return {static_cast<int>(index) * id_step, corpus.documents[index], static_cast<DocumentStatus>(index % 4), {static_cast<int>(index % 7)}};
+}
+
+//=================================================================================
+SearchServer MakeTestServer(const TestCorpus& corpus) {
+    SearchServer search_server(corpus.dictionary[0]);
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        const RawDocument document = MakeTestDocument(corpus, i);
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    return search_server;
+}
+
+//=================================================================================
+void AssertSameDocuments(const vector<Document>& documents, const vector<Document>& expected_documents, const string& hint) {
+    ASSERT_EQUAL_HINT(documents.size(), expected_documents.size(), hint);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        ASSERT_EQUAL_HINT(documents[i].id, expected_documents[i].id, hint);
+        ASSERT_HINT(abs(documents[i].relevance - expected_documents[i].relevance) < 1e-9, hint);
+        ASSERT_EQUAL_HINT(documents[i].rating, expected_documents[i].rating, hint);
+    }
+}
+
+//=================================================================================
+void AssertPostingListsCompacted(const SearchServer& search_server, const TestCorpus& corpus, const string& hint) {
+    for (const string& word : corpus.dictionary) {
+        const PostingListStats stats = search_server.GetPostingListStats(word);
+        ASSERT_HINT(stats.removed_posting_count == 0
+                    || stats.removed_posting_count < stats.posting_count * SearchServer::MAX_REMOVED_POSTINGS_SHARE,
+                    hint + ", word "s + word);
+    }
+}
+
+//=================================================================================
+void AssertSameServerState(const SearchServer& search_server, const SearchServer& expected_server, const TestCorpus& corpus, const string& hint) {
+    ASSERT_EQUAL_HINT(search_server.GetDocumentCount(), expected_server.GetDocumentCount(), hint);
+    ASSERT_EQUAL_HINT(vector<int>(search_server.begin(), search_server.end()),
+                      vector<int>(expected_server.begin(), expected_server.end()), hint);
+    for (const int document_id : expected_server) {
+        ASSERT_EQUAL_HINT(search_server.GetWordFrequencies(document_id), expected_server.GetWordFrequencies(document_id), hint);
+    }
+    SearchOptions top_hundred;
+    top_hundred.max_result_document_count = 100;
+    for (const string& query : corpus.queries) {
+        for (int status = 0; status < 4; ++status) {
+            AssertSameDocuments(search_server.FindTopDocuments(query, static_cast<DocumentStatus>(status), top_hundred),
+                                expected_server.FindTopDocuments(query, static_cast<DocumentStatus>(status), top_hundred),
+                                hint + ", query \""s + query + "\""s);
+        }
+    }
+    ASSERT_EQUAL_HINT(search_server.FindDuplicateDocuments(), expected_server.FindDuplicateDocuments(), hint);
+    for (const string& word : corpus.dictionary) {
+        const PostingListStats stats = search_server.GetPostingListStats(word);
+        const PostingListStats expected_stats = expected_server.GetPostingListStats(word);
+        ASSERT_EQUAL_HINT(stats.posting_count - stats.removed_posting_count,
+                          expected_stats.posting_count - expected_stats.removed_posting_count, hint + ", word "s + word);
+    }
+    AssertPostingListsCompacted(search_server, corpus, hint);
+    AssertPostingListsCompacted(expected_server, corpus, hint + " expected"s);
+}
+
+//=================================================================================
+void TestMaxScoreMatchesExhaustiveSearch() {
+    const TestCorpus corpus = GenerateTestCorpus(13, 200, 5'000, 30, 100, 8);
+    SearchServer search_server = MakeTestServer(corpus);
+    search_server.RemoveDocuments({10, 11, 500, 4'000});
+
+    for (const size_t max_result_document_count : {size_t{1}, size_t{MAX_RESULT_DOCUMENT_COUNT}, size_t{100}}) {
+        SearchOptions exhaustive;
+        exhaustive.max_result_document_count = max_result_document_count;
+        exhaustive.use_dynamic_pruning = false;
+        SearchOptions pruned = exhaustive;
+        pruned.use_dynamic_pruning = true;
+        const auto is_even = [](int document_id, DocumentStatus, int) { return document_id % 2 == 0; };
+        for (const string& query : corpus.queries) {
+            const string hint = "query \""s + query + "\" top "s + to_string(max_result_document_count);
+            AssertSameDocuments(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, pruned),
+                                search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, exhaustive), hint);
+            AssertSameDocuments(search_server.FindTopDocuments(query, DocumentStatus::BANNED, pruned),
+                                search_server.FindTopDocuments(query, DocumentStatus::BANNED, exhaustive), hint);
+            AssertSameDocuments(search_server.FindTopDocuments(query, is_even, pruned),
+                                search_server.FindTopDocuments(query, is_even, exhaustive), hint);
+        }
+    }
+}
+
+//=================================================================================
+void TestSnapshotRoundTrip() {
+    const TestCorpus corpus = GenerateTestCorpus(7, 300, 2'000, 30, 50, 6);
+    // Half of the documents is added one by one, half in a batch
+    SearchServer search_server(corpus.dictionary[0] + " "s + corpus.dictionary[1]);
+    for (size_t i = 0; i < corpus.documents.size() / 2; ++i) {
+        const RawDocument document = MakeTestDocument(corpus, i, 3);
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    vector<RawDocument> raw_documents;
+    for (size_t i = corpus.documents.size() / 2; i < corpus.documents.size(); ++i) {
+        raw_documents.push_back(MakeTestDocument(corpus, i, 3));
+    }
+    search_server.AddDocuments(raw_documents);
+    search_server.AddDocument(10'000, corpus.documents[1], DocumentStatus::ACTUAL, {1});
+    search_server.RemoveDocuments({0, 30, 3'000, 5'997});
+
+    const string snapshot_path = (filesystem::temp_directory_path() / "search_server_test_snapshot.bin").string();
+    search_server.SaveSnapshot(snapshot_path);
+    SearchServer loaded_server("unrelated stop words"s);
+    loaded_server.AddDocument(1, "document to be replaced"sv, DocumentStatus::ACTUAL, {1});
+    loaded_server.LoadSnapshot(snapshot_path);
+
+    ASSERT_EQUAL(loaded_server.GetDocumentCount(), search_server.GetDocumentCount());
+    ASSERT_EQUAL(vector<int>(loaded_server.begin(), loaded_server.end()), vector<int>(search_server.begin(), search_server.end()));
+    ASSERT_EQUAL(search_server.FindDuplicateDocuments(), vector<int>{10'000});
+    ASSERT_EQUAL(loaded_server.FindDuplicateDocuments(), search_server.FindDuplicateDocuments());
+    const vector<string>& queries = corpus.queries;
+    for (const int document_id : search_server) {
+        ASSERT_EQUAL(loaded_server.GetWordFrequencies(document_id), search_server.GetWordFrequencies(document_id));
+        const auto [matched_words, status] = search_server.MatchDocument(queries[document_id % queries.size()], document_id);
+        const auto [loaded_matched_words, loaded_status] = loaded_server.MatchDocument(queries[document_id % queries.size()], document_id);
+        ASSERT_EQUAL(loaded_matched_words, matched_words);
+        ASSERT(loaded_status == status);
+    }
+    for (const string& query : queries) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED}) {
+            AssertSameDocuments(loaded_server.FindTopDocuments(query, status), search_server.FindTopDocuments(query, status), query);
+        }
+    }
+
+    // A write that does not reach Finish leaves the previous snapshot and no temporary file
+    {
+        SnapshotWriter writer(snapshot_path);
+        writer.Write<uint64_t>(42);
+    }
+    ASSERT(!filesystem::exists(snapshot_path + ".tmp"s));
+    loaded_server.LoadSnapshot(snapshot_path);
+    ASSERT_EQUAL(loaded_server.GetDocumentCount(), search_server.GetDocumentCount());
+
+    ifstream snapshot_file(snapshot_path, ios::binary);
+    const string snapshot((istreambuf_iterator<char>(snapshot_file)), istreambuf_iterator<char>());
+    snapshot_file.close();
+    const string bad_snapshot_path = (filesystem::temp_directory_path() / "search_server_test_bad_snapshot.bin").string();
+    const auto assert_rejected = [&](string bad_snapshot, const string& hint) {
+        ofstream(bad_snapshot_path, ios::binary) << bad_snapshot;
+        bool is_thrown = false;
+        try {
+            loaded_server.LoadSnapshot(bad_snapshot_path);
+        } catch (const runtime_error&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown, hint);
+        ASSERT_EQUAL_HINT(loaded_server.GetDocumentCount(), search_server.GetDocumentCount(), hint);
+        AssertSameDocuments(loaded_server.FindTopDocuments(queries[0]), search_server.FindTopDocuments(queries[0]), hint);
+    };
+    string bad_snapshot = snapshot;
+    bad_snapshot[offsetof(SnapshotHeader, magic)] ^= 1;
+    assert_rejected(bad_snapshot, "bad magic"s);
+    bad_snapshot = snapshot;
+    ++bad_snapshot[offsetof(SnapshotHeader, version)];
+    assert_rejected(bad_snapshot, "bad version"s);
+    bad_snapshot = snapshot;
+    bad_snapshot[sizeof(SnapshotHeader) + (snapshot.size() - sizeof(SnapshotHeader)) / 2] ^= 1;
+    assert_rejected(bad_snapshot, "bad checksum"s);
+    assert_rejected(snapshot.substr(0, snapshot.size() - 1), "truncated"s);
+
+    remove(snapshot_path.c_str());
+    remove(bad_snapshot_path.c_str());
+}
+
+//=================================================================================
+void TestBatchQueryExecutorMatchesSequentialSearch() {
+    const TestCorpus corpus = GenerateTestCorpus(21, 60, 20'000, 30, 50, 3, 0.1);
+    const SearchServer search_server = MakeTestServer(corpus);
+    vector<string> queries = corpus.queries;
+    // Long enough to be split between the threads
+    mt19937 generator(21);
+    queries.push_back(GenerateQuery(generator, corpus.dictionary, 60));
+    queries.push_back(GenerateQuery(generator, corpus.dictionary, 60, 0.1));
+
+    BatchQueryExecutor executor(4);
+    const auto assert_sequential_results = [&](const vector<vector<Document>>& results, DocumentStatus status, const SearchOptions& options,
+                                               const string& hint) {
+        ASSERT_EQUAL_HINT(results.size(), queries.size(), hint);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            AssertSameDocuments(results[i], search_server.FindTopDocuments(execution::seq, queries[i], status, options), hint + " "s + queries[i]);
+        }
+    };
+    for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+        for (const bool use_dynamic_pruning : {true, false}) {
+            SearchOptions options;
+            options.use_dynamic_pruning = use_dynamic_pruning;
+            assert_sequential_results(executor.ProcessQueries(search_server, queries, status, options), status, options,
+                                      use_dynamic_pruning ? "pruned"s : "exhaustive"s);
+            ASSERT_EQUAL(executor.GetLastBatchStats().query_count, queries.size());
+            ASSERT_EQUAL(executor.GetLastBatchStats().split_query_count > 0, use_dynamic_pruning);
+        }
+    }
+    assert_sequential_results(ProcessQueries(search_server, queries), DocumentStatus::ACTUAL, {}, "default executor"s);
+
+    size_t next_query_index = 0;
+    executor.ProcessQueries(search_server, queries, [&](size_t query_index, vector<Document>&& documents) {
+        ASSERT_EQUAL(query_index, next_query_index++);
+        AssertSameDocuments(documents, search_server.FindTopDocuments(queries[query_index]), "streamed"s);
+        // The consumer runs on the calling thread and may start a batch of its own
+        AssertSameDocuments(executor.ProcessQueries(search_server, {queries[query_index]})[0], documents, "nested"s);
+    });
+    ASSERT_EQUAL(next_query_index, queries.size());
+
+    vector<vector<vector<Document>>> concurrent_results(4);
+    vector<thread> threads;
+    for (auto& results : concurrent_results) {
+        threads.emplace_back([&] { results = executor.ProcessQueries(search_server, queries); });
+    }
+    for (thread& thread : threads) {
+        thread.join();
+    }
+    for (const auto& results : concurrent_results) {
+        assert_sequential_results(results, DocumentStatus::ACTUAL, {}, "concurrent"s);
+    }
+}
+
+//=================================================================================
+void TestDocumentIdsAreIteratedInIncreasingOrder() {
+    SearchServer search_server("and"s);
+    for (const int document_id : {5, 1, 9, 3}) {
+        search_server.AddDocument(document_id, "cat"sv, DocumentStatus::ACTUAL, {1});
+    }
+    search_server.AddDocuments({{8, "dog"sv, DocumentStatus::ACTUAL, {1}},
+                                {2, "dog"sv, DocumentStatus::ACTUAL, {1}},
+                                {11, "dog"sv, DocumentStatus::ACTUAL, {1}}});
+    search_server.RemoveDocuments({3, 8});
+    search_server.RemoveDocument(42);
+
+    const vector<int> expected_ids = {1, 2, 5, 9, 11};
+    ASSERT_EQUAL(vector<int>(search_server.begin(), search_server.end()), expected_ids);
+    for (size_t i = 0; i < expected_ids.size(); ++i) {
+        ASSERT_EQUAL(search_server.GetDocumentId(static_cast<int>(i)), expected_ids[i]);
+    }
+
+    // Changes between two reads are merged at once: an id removed and added again, one added and removed
+    search_server.RemoveDocument(5);
+    search_server.AddDocument(5, "bird"sv, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(4, "bird"sv, DocumentStatus::ACTUAL, {1});
+    search_server.RemoveDocument(4);
+    search_server.RemoveDocument(1);
+    search_server.AddDocument(12, "bird"sv, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 5);
+    ASSERT_EQUAL(vector<int>(search_server.begin(), search_server.end()), vector<int>({2, 5, 9, 11, 12}));
+    ASSERT_EQUAL(search_server.GetDocumentId(0), 2);
+    ASSERT_EQUAL(search_server.FindDuplicateDocuments(), vector<int>({11, 12}));
+}
+
+//=================================================================================
+// Every block of postings decodes to the postings appended, with skip headers of its last ordinal and largest term frequency
+void AssertPostingListHolds(const PostingList& postings, const vector<int>& ordinals, const vector<uint32_t>& counts,
+                            const vector<double>& inv_word_counts, const string& hint) {
+    ASSERT_EQUAL_HINT(postings.size(), ordinals.size(), hint);
+    ASSERT_EQUAL_HINT(postings.GetBlockCount(), (ordinals.size() + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE, hint);
+    double max_term_freq = 0.;
+    vector<int> block_ordinals(POSTING_BLOCK_SIZE);
+    vector<uint32_t> block_counts(POSTING_BLOCK_SIZE);
+    for (size_t block = 0; block < postings.GetBlockCount(); ++block) {
+        const size_t first = block * POSTING_BLOCK_SIZE;
+        const size_t count = min(POSTING_BLOCK_SIZE, ordinals.size() - first);
+        ASSERT_EQUAL_HINT(postings.DecodeBlock(block, block_ordinals.data(), block_counts.data()), count, hint);
+        double block_max_term_freq = 0.;
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQUAL_HINT(block_ordinals[i], ordinals[first + i], hint);
+            ASSERT_EQUAL_HINT(block_counts[i], counts[first + i], hint);
+            block_max_term_freq = max(block_max_term_freq, ComputeTermFreq(counts[first + i], inv_word_counts[ordinals[first + i]]));
+        }
+        ASSERT_EQUAL_HINT(postings.GetBlockLastOrdinal(block), ordinals[first + count - 1], hint);
+        ASSERT_EQUAL_HINT(postings.GetBlockMaxTermFreq(block), block_max_term_freq, hint);
+        ASSERT_EQUAL_HINT(postings.FindBlock(ordinals[first]), block, hint);
+        ASSERT_EQUAL_HINT(postings.FindBlock(ordinals[first + count - 1] + 1), block + 1, hint);
+        max_term_freq = max(max_term_freq, block_max_term_freq);
+    }
+    ASSERT_EQUAL_HINT(postings.GetMaxTermFreq(), max_term_freq, hint);
+}
+
+//=================================================================================
+void TestPostingListRoundTrip() {
+    mt19937 generator(14);
+    const string snapshot_path = (filesystem::temp_directory_path() / "search_server_test_postings.bin").string();
+    for (const size_t posting_count : {1, 127, 128, 129, 255, 256, 257, 1'000}) {
+        for (const bool is_dense : {true, false}) {
+            const string hint = to_string(posting_count) + (is_dense ? " dense"s : " sparse"s) + " postings"s;
+            // Dense postings have consecutive ordinals and counts of 1, so their blocks pack into 0 bits
+            vector<int> ordinals;
+            vector<uint32_t> counts;
+            int ordinal = 0;
+            for (size_t i = 0; i < posting_count; ++i) {
+                ordinal += is_dense ? 1 : 1 + static_cast<int>(generator() % (i % 64 == 0 ? 100'000 : 100));
+                ordinals.push_back(ordinal);
+                counts.push_back(is_dense ? 1 : i % 100 == 0 ? numeric_limits<uint32_t>::max() - static_cast<uint32_t>(i) : 1 + generator() % 20);
+            }
+            vector<double> inv_word_counts(ordinal + 1);
+            for (double& inv_word_count : inv_word_counts) {
+                inv_word_count = 1. / (1 + generator() % 50);
+            }
+
+            PostingList postings;
+            for (size_t i = 0; i < posting_count; ++i) {
+                postings.Append(ordinals[i], counts[i], ComputeTermFreq(counts[i], inv_word_counts[ordinals[i]]));
+            }
+            AssertPostingListHolds(postings, ordinals, counts, inv_word_counts, hint);
+
+            {
+                SnapshotWriter writer(snapshot_path);
+                postings.Save(writer);
+                writer.Finish();
+            }
+            {
+                const MappedFile file(snapshot_path);
+                SnapshotReader reader(file);
+                PostingList loaded_postings;
+                loaded_postings.Load(reader);
+                ASSERT_HINT(reader.IsAtEnd(), hint);
+                AssertPostingListHolds(loaded_postings, ordinals, counts, inv_word_counts, hint + " loaded"s);
+            }
+
+            vector<bool> removed_ordinals(ordinal + 1, false);
+            vector<int> kept_ordinals;
+            vector<uint32_t> kept_counts;
+            for (size_t i = 0; i < posting_count; ++i) {
+                removed_ordinals[ordinals[i]] = i % 3 == 1;
+                if (!removed_ordinals[ordinals[i]]) {
+                    kept_ordinals.push_back(ordinals[i]);
+                    kept_counts.push_back(counts[i]);
+                }
+            }
+            postings.Compact(removed_ordinals, inv_word_counts);
+            AssertPostingListHolds(postings, kept_ordinals, kept_counts, inv_word_counts, hint + " compacted"s);
+        }
+    }
+    remove(snapshot_path.c_str());
+}
+
+//=================================================================================
+void AssertBitmapHolds(const DocumentBitmap& bitmap, const set<int>& ordinals, int ordinal_end, const string& hint) {
+    ASSERT_EQUAL_HINT(bitmap.size(), ordinals.size(), hint);
+    ASSERT_EQUAL_HINT(bitmap.empty(), ordinals.empty(), hint);
+    for (int ordinal = 0; ordinal < ordinal_end; ++ordinal) {
+        ASSERT_EQUAL_HINT(bitmap.Contains(ordinal), ordinals.count(ordinal) > 0, hint + " ordinal "s + to_string(ordinal));
+    }
+}
+
+//=================================================================================
+void TestDocumentBitmapMatchesSet() {
+    mt19937 generator(15);
+    const int chunk_size = 1 << 16;
+    const int ordinal_end = 4 * chunk_size;
+
+    // Chunks 0 and 1 get dense, chunks 2 and 3 stay sparse
+    DocumentBitmap status_bitmap;
+    set<int> status_ordinals;
+    for (int ordinal = 0; ordinal < ordinal_end; ++ordinal) {
+        if (generator() % 100 < (ordinal < 2 * chunk_size ? 40u : 1u) || ordinal == chunk_size - 1 || ordinal == chunk_size) {
+            status_bitmap.Add(ordinal);
+            status_ordinals.insert(ordinal);
+        }
+    }
+    AssertBitmapHolds(status_bitmap, status_ordinals, ordinal_end, "added"s);
+
+    // Chunk 0 falls back to a sorted array, removing what is missing changes nothing
+    for (int ordinal = 0; ordinal < chunk_size; ++ordinal) {
+        if (ordinal % 50 != 0) {
+            status_bitmap.Remove(ordinal);
+            status_ordinals.erase(ordinal);
+        }
+    }
+    status_bitmap.Remove(3 * chunk_size + 1);
+    status_ordinals.erase(3 * chunk_size + 1);
+    status_bitmap.Remove(ordinal_end + 10);
+    AssertBitmapHolds(status_bitmap, status_ordinals, ordinal_end, "removed"s);
+
+    // Union of overlapping sorted runs, as the postings of the minus words are merged
+    DocumentBitmap minus_bitmap;
+    set<int> minus_ordinals;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (const int step : {1, 7, 1'000}) {
+            vector<int> run;
+            for (int ordinal = static_cast<int>(generator() % 100); ordinal < ordinal_end; ordinal += step) {
+                if (step != 1 || generator() % 2 == 0) {
+                    run.push_back(ordinal);
+                }
+            }
+            minus_bitmap.Add(run.data(), run.size());
+            minus_ordinals.insert(run.begin(), run.end());
+        }
+        AssertBitmapHolds(minus_bitmap, minus_ordinals, ordinal_end, "union pass "s + to_string(pass));
+
+        // Documents of the status without the minus words
+        vector<int> expected_ordinals;
+        set_difference(status_ordinals.begin(), status_ordinals.end(), minus_ordinals.begin(), minus_ordinals.end(),
+                       back_inserter(expected_ordinals));
+        vector<int> filtered_ordinals;
+        for (int ordinal = 0; ordinal < ordinal_end; ++ordinal) {
+            if (status_bitmap.Contains(ordinal) && !minus_bitmap.Contains(ordinal)) {
+                filtered_ordinals.push_back(ordinal);
+            }
+        }
+        ASSERT_EQUAL_HINT(filtered_ordinals, expected_ordinals, "filter pass "s + to_string(pass));
+
+        // Reused for the next query
+        minus_bitmap.Clear();
+        minus_ordinals.clear();
+        AssertBitmapHolds(minus_bitmap, minus_ordinals, ordinal_end, "cleared"s);
+    }
+}
+
+//=================================================================================
+void TestWordFrequencies() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "cat and dog cat"sv, DocumentStatus::ACTUAL, {1});
+    const map<string_view, double>& word_freqs = search_server.GetWordFrequencies(1);
+    ASSERT_EQUAL(word_freqs, (map<string_view, double>{{"cat"sv, 2. / 3}, {"dog"sv, 1. / 3}}));
+    ASSERT_EQUAL(&search_server.GetWordFrequencies(1), &word_freqs);
+
+    // Other documents do not move the map
+    for (int document_id = 2; document_id < 100; ++document_id) {
+        search_server.AddDocument(document_id, "bird cat"sv, DocumentStatus::ACTUAL, {1});
+        search_server.GetWordFrequencies(document_id);
+    }
+    search_server.RemoveDocument(2);
+    ASSERT_EQUAL(&search_server.GetWordFrequencies(1), &word_freqs);
+    ASSERT_EQUAL(word_freqs.size(), 2u);
+
+    ASSERT(search_server.GetWordFrequencies(2).empty());
+    ASSERT(search_server.GetWordFrequencies(1'000).empty());
+}
+
+//=================================================================================
+void TestRequestQueueWindowRollsOver() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "cat and dog"sv, DocumentStatus::ACTUAL, {1});
+
+    // Every reading of the clock takes 1 µs, so each request has a latency of 1 µs
+    const auto start = chrono::steady_clock::time_point{} + chrono::hours(1);
+    chrono::steady_clock::time_point now = start;
+    const auto fake_clock = [&now] {
+        now += chrono::microseconds(1);
+        return now;
+    };
+    const auto set_time = [&now, start](chrono::milliseconds time) {
+        now = start + time;
+    };
+
+    RequestQueue request_queue(search_server, chrono::milliseconds(400), 4, fake_clock);
+    for (int i = 0; i < 3; ++i) {
+        request_queue.AddFindRequest("bird"s);
+    }
+    ASSERT_EQUAL(request_queue.GetWindowStats().request_count, 3u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 3);
+    ASSERT_EQUAL(request_queue.GetWindowStats().total_latency.count(), 3'000);
+
+    set_time(chrono::milliseconds(200));
+    request_queue.AddFindRequest("bird"s);
+    request_queue.AddFindRequest("cat"s);
+    ASSERT_EQUAL(request_queue.GetWindowStats().request_count, 5u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 4);
+
+    // The last moment of the first bucket's round: still counted
+    set_time(chrono::milliseconds(399));
+    ASSERT_EQUAL(request_queue.GetWindowStats().request_count, 5u);
+
+    // The first bucket leaves the window, the one of 200 ms stays
+    set_time(chrono::milliseconds(450));
+    const RequestWindowStats stats = request_queue.GetWindowStats();
+    ASSERT_EQUAL(stats.request_count, 2u);
+    ASSERT_EQUAL(stats.no_result_request_count, 1u);
+    ASSERT_EQUAL(stats.total_latency.count(), 2'000);
+
+    // A request reusing a bucket of the previous round replaces its counts
+    set_time(chrono::milliseconds(620));
+    request_queue.AddFindRequest("dog"s);
+    ASSERT_EQUAL(request_queue.GetWindowStats().request_count, 1u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+
+    // A pause of several windows expires everything at once
+    set_time(chrono::milliseconds(5'000));
+    ASSERT_EQUAL(request_queue.GetWindowStats().request_count, 0u);
+    ASSERT_EQUAL(request_queue.GetWindowStats().total_latency.count(), 0);
+    request_queue.AddFindRequest("bird"s);
+    ASSERT_EQUAL(request_queue.GetWindowStats().request_count, 1u);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+
+    RequestQueue shared_request_queue(search_server);
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&shared_request_queue] {
+            for (int i = 0; i < 1'000; ++i) {
+                shared_request_queue.AddFindRequest(i % 4 == 0 ? "bird"s : "cat"s);
+            }
+        });
+    }
+    for (thread& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQUAL(shared_request_queue.GetWindowStats().request_count, 4'000u);
+    ASSERT_EQUAL(shared_request_queue.GetNoResultRequests(), 1'000);
+}
+
+//=================================================================================
+void TestShardedAddDocumentsRejectsInvalidStatus() {
+    ShardedSearchServer search_server(4, "and"s);
+    bool is_thrown = false;
+    try {
+        search_server.AddDocuments({{1, "cat"sv, static_cast<DocumentStatus>(7), {1}}});
+    } catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "invalid status must be rejected"s);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 0);
+}
+
+//=================================================================================
+void TestShardedSearchMatchesSingleServer() {
+    const TestCorpus corpus = GenerateTestCorpus(29, 300, 4'000, 30, 60, 6);
+    SearchServer search_server = MakeTestServer(corpus);
+
+    // Half of the documents come in a batch, the rest one by one
+    ShardedSearchServer sharded_search_server(3, corpus.dictionary[0]);
+    vector<RawDocument> batch;
+    for (size_t i = 0; i < corpus.documents.size() / 2; ++i) {
+        batch.push_back(MakeTestDocument(corpus, i));
+    }
+    sharded_search_server.AddDocuments(batch);
+    for (size_t i = corpus.documents.size() / 2; i < corpus.documents.size(); ++i) {
+        const RawDocument document = MakeTestDocument(corpus, i);
+        sharded_search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+
+    const auto assert_same_results = [&](const string& stage) {
+        ASSERT_EQUAL_HINT(sharded_search_server.GetDocumentCount(), search_server.GetDocumentCount(), stage);
+        const auto is_odd = [](int document_id, DocumentStatus, int) { return document_id % 2 == 1; };
+        SearchOptions top_hundred;
+        top_hundred.max_result_document_count = 100;
+        for (const string& query : corpus.queries) {
+            const string hint = stage + ", query \""s + query + "\""s;
+            const vector<Document> expected_documents = search_server.FindTopDocuments(query);
+            const vector<Document> documents = sharded_search_server.FindTopDocuments(query);
+            AssertSameDocuments(documents, expected_documents, hint);
+            // Sequential scores are summed in the same order with the same IDF
+            for (size_t i = 0; i < documents.size(); ++i) {
+                ASSERT_EQUAL_HINT(documents[i].relevance, expected_documents[i].relevance, hint);
+            }
+            AssertSameDocuments(sharded_search_server.FindTopDocuments(execution::seq, query), expected_documents, hint + " seq"s);
+            AssertSameDocuments(sharded_search_server.FindTopDocuments(execution::par, query), expected_documents, hint + " par"s);
+            AssertSameDocuments(sharded_search_server.FindTopDocuments(query, DocumentStatus::BANNED, top_hundred),
+                                search_server.FindTopDocuments(query, DocumentStatus::BANNED, top_hundred), hint + " banned"s);
+            AssertSameDocuments(sharded_search_server.FindTopDocuments(query, is_odd),
+                                search_server.FindTopDocuments(query, is_odd), hint + " odd"s);
+        }
+    };
+    assert_same_results("initial"s);
+
+    // A third of the documents, more than the share of removed postings a shard keeps before compacting
+    for (size_t i = 0; i < corpus.documents.size(); i += 3) {
+        search_server.RemoveDocument(static_cast<int>(i));
+        sharded_search_server.RemoveDocument(static_cast<int>(i));
+    }
+    assert_same_results("after removals"s);
+
+    for (size_t i = 0; i < corpus.documents.size(); i += 3) {
+        const RawDocument document = MakeTestDocument(corpus, i);
+        search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        sharded_search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    assert_same_results("after adding again"s);
+}
+
+//=================================================================================
+void TestSplitIntoWordsMatchesScalarSplit() {
+    const auto split_by_bytes = [](string_view text, vector<string_view>& words) {
+        words.clear();
+        bool has_control_characters = false;
+        size_t word_begin = string_view::npos;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i == text.size() || text[i] == ' ') {
+                if (word_begin != string_view::npos) {
+                    words.push_back(text.substr(word_begin, i - word_begin));
+                    word_begin = string_view::npos;
+                }
+                continue;
+            }
+            has_control_characters |= static_cast<unsigned char>(text[i]) < ' ';
+            if (word_begin == string_view::npos) {
+                word_begin = i;
+            }
+        }
+        return !has_control_characters;
+    };
+
+    vector<SplitInstructions> instruction_sets;
+    for (const SplitInstructions instructions : {SplitInstructions::SCALAR, SplitInstructions::SSE2, SplitInstructions::AVX2}) {
+        if (IsSupported(instructions)) {
+            instruction_sets.push_back(instructions);
+        }
+    }
+    ASSERT(IsSupported(SplitInstructions::SCALAR));
+
+    vector<string_view> words;
+    vector<string_view> expected_words;
+    const auto assert_same_split = [&](string_view text, const string& hint) {
+        const bool expected_is_valid = split_by_bytes(text, expected_words);
+        for (const SplitInstructions instructions : instruction_sets) {
+            const string instructions_hint = hint + ", instructions "s + to_string(static_cast<int>(instructions));
+            ASSERT_EQUAL_HINT(SplitIntoWords(text, words, instructions), expected_is_valid, instructions_hint);
+            // The same words at the same places of the text
+            ASSERT_EQUAL_HINT(words.size(), expected_words.size(), instructions_hint);
+            for (size_t i = 0; i < words.size(); ++i) {
+                ASSERT_HINT(words[i].data() == expected_words[i].data() && words[i].size() == expected_words[i].size(), instructions_hint);
+            }
+        }
+        ASSERT_EQUAL_HINT(SplitIntoWords(text, words), expected_is_valid, hint);
+        ASSERT_EQUAL_HINT(words, expected_words, hint);
+    };
+
+    // One word at every position and of every length around the block edges, in a text of spaces
+    for (size_t begin = 0; begin < 40; ++begin) {
+        for (size_t size = 1; size < 40; ++size) {
+            string text(begin + size + 40, ' ');
+            fill_n(text.begin() + begin, size, 'w');
+            assert_same_split(text, "word at "s + to_string(begin) + " of "s + to_string(size) + " bytes"s);
+            // Without the trailing spaces the word ends with the text
+            assert_same_split(string_view(text).substr(0, begin + size), "word ending the text at "s + to_string(begin));
+        }
+    }
+
+    assert_same_split(""sv, "empty"s);
+    assert_same_split(string(100, ' '), "only spaces"s);
+    assert_same_split(string(100, 'w'), "one long word"s);
+
+    // Random texts at every alignment of the buffer, of spaces, letters, control characters and high bytes
+    const string alphabet = "   ab\t\n\x01\x1f\x7f\x80\xd0\xff"s;
+    mt19937 generator(31);
+    uniform_int_distribution<size_t> byte_index(0, alphabet.size() - 1);
+    uniform_int_distribution<size_t> text_size(0, 200);
+    for (int i = 0; i < 2'000; ++i) {
+        string buffer(32 + text_size(generator), ' ');
+        for (char& c : buffer) {
+            c = alphabet[byte_index(generator)];
+        }
+        const size_t offset = i % 32;
+        assert_same_split(string_view(buffer).substr(offset), "random text "s + to_string(i) + " at offset "s + to_string(offset));
+    }
+}
+
+//=================================================================================
+void TestQueryResultCache() {
+    const vector<Document> cat_documents = {{1, 0.5, 2}, {3, 0.25, 1}};
+    const vector<Document> dog_documents = {{2, 0.75, 4}};
+    {
+        QueryResultCache cache(2, 1);
+        const string cat_key = QueryResultCache::MakeKey({"cat"sv}, {}, DocumentStatus::ACTUAL, 5);
+        const string dog_key = QueryResultCache::MakeKey({"dog"sv}, {}, DocumentStatus::ACTUAL, 5);
+        const string bird_key = QueryResultCache::MakeKey({"bird"sv}, {}, DocumentStatus::ACTUAL, 5);
+        // Words, minus words, status and result count all tell keys apart
+        ASSERT(cat_key != QueryResultCache::MakeKey({}, {"cat"sv}, DocumentStatus::ACTUAL, 5));
+        ASSERT(cat_key != QueryResultCache::MakeKey({"cat"sv}, {}, DocumentStatus::BANNED, 5));
+        ASSERT(cat_key != QueryResultCache::MakeKey({"cat"sv}, {}, DocumentStatus::ACTUAL, 50));
+
+        ASSERT(!cache.Find(cat_key, 0));
+        cache.Insert(cat_key, 0, cat_documents);
+        const auto cached = cache.Find(cat_key, 0);
+        ASSERT(cached.has_value());
+        AssertSameDocuments(*cached, cat_documents, "hit"s);
+
+        // An entry of another epoch misses and is dropped
+        ASSERT(!cache.Find(cat_key, 1));
+        ASSERT(!cache.Find(cat_key, 0));
+        QueryCacheStats stats = cache.GetStats();
+        ASSERT_EQUAL(stats.hits, 1u);
+        ASSERT_EQUAL(stats.misses, 3u);
+        ASSERT_EQUAL(stats.size, 0u);
+
+        // Using cat makes dog the least recently used entry, the third entry evicts it
+        cache.Insert(cat_key, 1, cat_documents);
+        cache.Insert(dog_key, 1, dog_documents);
+        ASSERT(cache.Find(cat_key, 1));
+        cache.Insert(bird_key, 1, {});
+        ASSERT(!cache.Find(dog_key, 1));
+        ASSERT(cache.Find(cat_key, 1));
+        ASSERT(cache.Find(bird_key, 1));
+        // Inserting a key again replaces its entry without evicting
+        cache.Insert(cat_key, 2, dog_documents);
+        AssertSameDocuments(*cache.Find(cat_key, 2), dog_documents, "replaced"s);
+        stats = cache.GetStats();
+        ASSERT_EQUAL(stats.hits, 5u);
+        ASSERT_EQUAL(stats.misses, 4u);
+        ASSERT_EQUAL(stats.evictions, 1u);
+        ASSERT_EQUAL(stats.size, 2u);
+
+        QueryResultCache disabled_cache(0, 1);
+        disabled_cache.Insert(cat_key, 0, cat_documents);
+        ASSERT(!disabled_cache.Find(cat_key, 0));
+        ASSERT_EQUAL(disabled_cache.GetStats().size, 0u);
+
+        // Filled far past the capacity, the cache holds exactly that many entries, the latest one among them
+        for (const size_t capacity : {1u, 2u, 15u, 16u, 17u, 40u}) {
+            QueryResultCache small_cache(capacity);
+            const size_t inserted_count = capacity * 8;
+            string key;
+            for (size_t i = 0; i < inserted_count; ++i) {
+                key = QueryResultCache::MakeKey({}, {}, DocumentStatus::ACTUAL, i);
+                small_cache.Insert(key, 0, cat_documents);
+            }
+            const string hint = "capacity "s + to_string(capacity);
+            ASSERT_HINT(small_cache.Find(key, 0).has_value(), hint);
+            const QueryCacheStats small_stats = small_cache.GetStats();
+            ASSERT_EQUAL_HINT(small_stats.size, capacity, hint);
+            ASSERT_EQUAL_HINT(small_stats.evictions, inserted_count - capacity, hint);
+        }
+    }
+
+    const TestCorpus corpus = GenerateTestCorpus(37, 200, 1'000, 20, 30, 5);
+    SearchServer search_server = MakeTestServer(corpus);
+    SearchServer uncached_search_server = MakeTestServer(corpus);
+    search_server.SetQueryCacheCapacity(1'000);
+    const auto assert_same_as_uncached = [&](const string& stage, uint64_t expected_hits, uint64_t expected_misses) {
+        for (const string& query : corpus.queries) {
+            AssertSameDocuments(search_server.FindTopDocuments(query), uncached_search_server.FindTopDocuments(query),
+                                stage + ", query \""s + query + "\""s);
+        }
+        const QueryCacheStats stats = search_server.GetQueryCacheStats();
+        ASSERT_EQUAL_HINT(stats.hits, expected_hits, stage);
+        ASSERT_EQUAL_HINT(stats.misses, expected_misses, stage);
+    };
+    const uint64_t query_count = corpus.queries.size();
+    assert_same_as_uncached("first run"s, 0, query_count);
+    assert_same_as_uncached("second run"s, query_count, query_count);
+
+    // The same words in another order and repeated normalize to the same key
+    const vector<string_view> words = SplitIntoWords(corpus.queries[0]);
+    string reordered_query;
+    for (auto word = words.rbegin(); word != words.rend(); ++word) {
+        reordered_query.append(*word).append(" "s).append(*word).append(" "s);
+    }
+    search_server.FindTopDocuments(reordered_query);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, query_count + 1);
+
+    // Every change of the index invalidates the cached results
+    search_server.RemoveDocument(0);
+    uncached_search_server.RemoveDocument(0);
+    assert_same_as_uncached("after RemoveDocument"s, query_count + 1, 2 * query_count);
+    const RawDocument document = MakeTestDocument(corpus, 0);
+    search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    uncached_search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    assert_same_as_uncached("after AddDocument"s, query_count + 1, 3 * query_count);
+    search_server.RemoveDocuments({1, 2});
+    uncached_search_server.RemoveDocuments({1, 2});
+    assert_same_as_uncached("after RemoveDocuments"s, query_count + 1, 4 * query_count);
+    assert_same_as_uncached("unchanged"s, 2 * query_count + 1, 4 * query_count);
+
+    search_server.SetQueryCacheCapacity(0);
+    search_server.FindTopDocuments(corpus.queries[0]);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, 0u);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().size, 0u);
+}
+
+//=================================================================================
+void TestSearchFilterMatchesPredicate() {
+    const TestCorpus corpus = GenerateTestCorpus(41, 200, 3'000, 25, 20, 5);
+    SearchServer search_server = MakeTestServer(corpus);
+    search_server.RemoveDocuments({3, 4, 5, 100, 2'000});
+
+    mt19937 generator(43);
+    const int document_count = static_cast<int>(corpus.documents.size());
+    uniform_int_distribution<int> id_distribution(-10, document_count + 10);
+    uniform_int_distribution<int> rating_distribution(-1, 7);
+    SearchContext context;
+    for (int i = 0; i < 40; ++i) {
+        // Every status subset in turn, ranges that may be empty of documents or cover all of them
+        vector<DocumentStatus> statuses;
+        for (int status = 0; status < 4; ++status) {
+            if ((i >> status) & 1) {
+                statuses.push_back(static_cast<DocumentStatus>(status));
+            }
+        }
+        const int rating_bounds[] = {rating_distribution(generator), rating_distribution(generator)};
+        const int id_bounds[] = {id_distribution(generator), id_distribution(generator)};
+        const int min_rating = min(rating_bounds[0], rating_bounds[1]);
+        const int max_rating = max(rating_bounds[0], rating_bounds[1]);
+        const int min_id = min(id_bounds[0], id_bounds[1]);
+        const int max_id = max(id_bounds[0], id_bounds[1]);
+        vector<int> allowed_ids;
+        for (int j = 0; j < 300; ++j) {
+            allowed_ids.push_back(id_distribution(generator));
+        }
+        const bool has_allowed_ids = i % 3 == 0;
+
+        SearchFilter filter;
+        switch (statuses.size()) {
+        case 0: filter.SetStatuses({}); break;
+        case 1: filter.SetStatuses({statuses[0]}); break;
+        case 2: filter.SetStatuses({statuses[0], statuses[1]}); break;
+        case 3: filter.SetStatuses({statuses[0], statuses[1], statuses[2]}); break;
+        default: filter.SetStatuses({statuses[0], statuses[1], statuses[2], statuses[3]}); break;
+        }
+        filter.SetRatingRange(min_rating, max_rating).SetIdRange(min_id, max_id);
+        if (has_allowed_ids) {
+            filter.SetAllowedIds(allowed_ids);
+        }
+        const set<int> allowed_id_set(allowed_ids.begin(), allowed_ids.end());
+        const auto predicate = [&](int document_id, DocumentStatus status, int rating) {
+            return find(statuses.begin(), statuses.end(), status) != statuses.end()
+                    && rating >= min_rating && rating <= max_rating
+                    && document_id >= min_id && document_id <= max_id
+                    && (!has_allowed_ids || allowed_id_set.count(document_id) > 0);
+        };
+
+        for (int document_id = -10; document_id < 20; ++document_id) {
+            for (int status = 0; status < 4; ++status) {
+                for (int rating = -1; rating < 8; ++rating) {
+                    ASSERT_EQUAL(filter(document_id, static_cast<DocumentStatus>(status), rating),
+                                 predicate(document_id, static_cast<DocumentStatus>(status), rating));
+                }
+            }
+        }
+        for (const string& query : corpus.queries) {
+            const string hint = "filter "s + to_string(i) + ", query \""s + query + "\""s;
+            const vector<Document> expected_documents = search_server.FindTopDocuments(query, predicate);
+            AssertSameDocuments(search_server.FindTopDocuments(query, filter), expected_documents, hint);
+            AssertSameDocuments(search_server.FindTopDocuments(execution::seq, query, filter), expected_documents, hint + " seq"s);
+            AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, filter), expected_documents, hint + " par"s);
+            AssertSameDocuments(search_server.FindTopDocuments(context, query, filter), expected_documents, hint + " context"s);
+        }
+    }
+
+    // A default filter accepts every document
+    for (const string& query : corpus.queries) {
+        AssertSameDocuments(search_server.FindTopDocuments(query, SearchFilter()),
+                            search_server.FindTopDocuments(query, [](int, DocumentStatus, int) { return true; }), "default filter"s);
+    }
+
+    for (const int status : {-1, 4, 31, 32, 1'000}) {
+        bool is_thrown = false;
+        try {
+            SearchFilter().SetStatuses({DocumentStatus::ACTUAL, static_cast<DocumentStatus>(status)});
+        } catch (const invalid_argument&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown, "status "s + to_string(status));
+        ASSERT_HINT(!SearchFilter()(1, static_cast<DocumentStatus>(status), 1), "status "s + to_string(status));
+    }
+}
+
+//=================================================================================
+void TestMatchDocumentMatchesBaseline() {
+    TestCorpus corpus = GenerateTestCorpus(47, 60, 500, 12, 80, 6, 0.3);
+    const string& stop_word = corpus.dictionary[0];
+    // Stop words as plus and minus words, and repeated words
+    for (size_t i = 0; i < corpus.queries.size(); i += 4) {
+        corpus.queries[i] += " "s + stop_word;
+        corpus.queries[i + 1] += " -"s + stop_word;
+        corpus.queries[i + 2] += " "s + corpus.queries[i + 2];
+    }
+    corpus.queries.push_back(""s);
+    corpus.queries.push_back(stop_word);
+    SearchServer search_server = MakeTestServer(corpus);
+    vector<int> removed_document_ids;
+    for (int document_id = 0; document_id < static_cast<int>(corpus.documents.size()); document_id += 7) {
+        removed_document_ids.push_back(document_id);
+    }
+    search_server.RemoveDocuments(removed_document_ids);
+
+    const auto match_by_words = [&](const string& query, size_t index) {
+        const vector<string_view> document_words = SplitIntoWords(corpus.documents[index]);
+        const set<string_view> document_word_set(document_words.begin(), document_words.end());
+        set<string_view> matched_words;
+        for (const string_view word : SplitIntoWords(query)) {
+            const bool is_minus = word[0] == '-';
+            const string_view term = is_minus ? word.substr(1) : word;
+            if (term == stop_word || document_word_set.count(term) == 0) {
+                continue;
+            }
+            if (is_minus) {
+                return vector<string_view>();
+            }
+            matched_words.insert(term);
+        }
+        return vector<string_view>(matched_words.begin(), matched_words.end());
+    };
+    const auto assert_same_match = [](const tuple<vector<string_view>, DocumentStatus>& match,
+                                      const vector<string_view>& expected_words, DocumentStatus expected_status, const string& hint) {
+        ASSERT_EQUAL_HINT(get<0>(match), expected_words, hint);
+        ASSERT_HINT(get<1>(match) == expected_status, hint);
+    };
+
+    SearchContext context;
+    vector<int> live_document_ids;
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        if (i % 7 != 0) {
+            live_document_ids.push_back(static_cast<int>(i));
+        }
+    }
+    for (const string& query : corpus.queries) {
+        const auto matches = search_server.MatchDocuments(query, live_document_ids);
+        const auto seq_matches = search_server.MatchDocuments(execution::seq, query, live_document_ids);
+        const auto par_matches = search_server.MatchDocuments(execution::par, query, live_document_ids);
+        ASSERT_EQUAL(matches.size(), live_document_ids.size());
+        ASSERT_EQUAL(seq_matches.size(), live_document_ids.size());
+        ASSERT_EQUAL(par_matches.size(), live_document_ids.size());
+        for (size_t i = 0; i < live_document_ids.size(); ++i) {
+            const int document_id = live_document_ids[i];
+            const string hint = "query \""s + query + "\", document "s + to_string(document_id);
+            const vector<string_view> expected_words = match_by_words(query, document_id);
+            const DocumentStatus expected_status = MakeTestDocument(corpus, document_id).status;
+            assert_same_match(search_server.MatchDocument(query, document_id), expected_words, expected_status, hint);
+            assert_same_match(search_server.MatchDocument(execution::seq, query, document_id), expected_words, expected_status, hint + " seq"s);
+            assert_same_match(search_server.MatchDocument(execution::par, query, document_id), expected_words, expected_status, hint + " par"s);
+            const auto [context_words, context_status] = search_server.MatchDocument(context, query, document_id);
+            assert_same_match({context_words, context_status}, expected_words, expected_status, hint + " context"s);
+            assert_same_match(matches[i], expected_words, expected_status, hint + " batch"s);
+            assert_same_match(seq_matches[i], expected_words, expected_status, hint + " batch seq"s);
+            assert_same_match(par_matches[i], expected_words, expected_status, hint + " batch par"s);
+        }
+    }
+
+    // Removed and unknown documents, and invalid queries, are errors as before
+    const auto assert_throws = [](const auto& match, const string& hint) {
+        bool is_thrown = false;
+        try {
+            match();
+        } catch (const logic_error&) {
+            is_thrown = true;
+        }
+        ASSERT_HINT(is_thrown, hint);
+    };
+    const string& query = corpus.queries[1];
+    assert_throws([&] { search_server.MatchDocument(query, 0); }, "removed document"s);
+    assert_throws([&] { search_server.MatchDocument(execution::par, query, 100'000); }, "unknown document"s);
+    assert_throws([&] { search_server.MatchDocuments(query, {1, 0, 2}); }, "removed document in a batch"s);
+    assert_throws([&] { search_server.MatchDocument(query + " --cat"s, 1); }, "double minus"s);
+    assert_throws([&] { search_server.MatchDocuments(execution::par, query + " -"s, {1}); }, "lone minus"s);
+    assert_throws([&] { search_server.MatchDocument(context, query + " c\x01t"s, 1); }, "control character"s);
+}
+
+//=================================================================================
+void TestRemoveDuplicatesKeepsLowestId() {
+    // Documents made of a few base word sets, reordered, with repeated words and stop words
+    mt19937 generator(53);
+    const vector<string> dictionary = GenerateDictionary(generator, 40, 6);
+    const string& stop_word = dictionary[0];
+    vector<vector<string>> word_sets(60);
+    for (vector<string>& words : word_sets) {
+        uniform_int_distribution<size_t> word_index(1, dictionary.size() - 1);
+        for (int i = 0; i < 4; ++i) {
+            words.push_back(dictionary[word_index(generator)]);
+        }
+    }
+    vector<int> document_ids(1'500);
+    iota(document_ids.begin(), document_ids.end(), 0);
+    for (int& document_id : document_ids) {
+        document_id = document_id * 3 + 1;
+    }
+    shuffle(document_ids.begin(), document_ids.end(), generator);
+
+    SearchServer search_server(stop_word);
+    map<int, set<string>> id_to_word_set;
+    vector<string> texts;
+    texts.reserve(document_ids.size());
+    uniform_int_distribution<size_t> word_set_index(0, word_sets.size() - 1);
+    for (const int document_id : document_ids) {
+        vector<string> words = word_sets[word_set_index(generator)];
+        words.push_back(words[0]);
+        words.push_back(stop_word);
+        if (document_id % 5 == 0) {
+            words.push_back(dictionary[document_id % (dictionary.size() - 1) + 1]);
+        }
+        id_to_word_set[document_id] = set<string>(words.begin(), words.end());
+        id_to_word_set[document_id].erase(stop_word);
+        shuffle(words.begin(), words.end(), generator);
+        string text;
+        for (const string& word : words) {
+            text += word + " "s;
+        }
+        texts.push_back(move(text));
+        search_server.AddDocument(document_id, texts.back(), static_cast<DocumentStatus>(document_id % 4), {document_id % 7});
+    }
+    // A removed document leaves nothing to be a duplicate of
+    const int removed_document_id = id_to_word_set.begin()->first;
+    search_server.RemoveDocument(removed_document_id);
+    id_to_word_set.erase(removed_document_id);
+
+    set<set<string>> seen_word_sets;
+    vector<int> expected_duplicate_ids;
+    vector<int> expected_kept_ids;
+    for (const auto& [document_id, word_set] : id_to_word_set) {
+        if (seen_word_sets.insert(word_set).second) {
+            expected_kept_ids.push_back(document_id);
+        } else {
+            expected_duplicate_ids.push_back(document_id);
+        }
+    }
+    ASSERT(!expected_duplicate_ids.empty());
+    ASSERT_EQUAL(search_server.FindDuplicateDocuments(), expected_duplicate_ids);
+
+    ostringstream output;
+    streambuf* const cout_buffer = cout.rdbuf(output.rdbuf());
+    RemoveDuplicates(search_server);
+    cout.rdbuf(cout_buffer);
+
+    string expected_output;
+    for (auto document_id = expected_duplicate_ids.rbegin(); document_id != expected_duplicate_ids.rend(); ++document_id) {
+        expected_output += "Found duplicate document id "s + to_string(*document_id) + "\n"s;
+    }
+    ASSERT_EQUAL(output.str(), expected_output);
+    ASSERT_EQUAL(vector<int>(search_server.begin(), search_server.end()), expected_kept_ids);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), static_cast<int>(expected_kept_ids.size()));
+    ASSERT(search_server.FindDuplicateDocuments().empty());
+
+    // The kept documents are still found with their own words
+    for (const int document_id : expected_kept_ids) {
+        const string& word = *id_to_word_set[document_id].begin();
+        const auto [matched_words, status] = search_server.MatchDocument(word, document_id);
+        ASSERT_EQUAL(matched_words.size(), 1u);
+        ASSERT(status == static_cast<DocumentStatus>(document_id % 4));
+    }
+}
+
+//=================================================================================
+void TestProcessQueriesJoinedMatchesProcessQueries() {
+    TestCorpus corpus = GenerateTestCorpus(59, 300, 2'000, 20, 200, 4);
+    // Queries without results: an unknown word, only a minus word, and a stop word
+    corpus.queries[3] = "unknownword"s;
+    corpus.queries[50] = "-"s + corpus.dictionary[1];
+    corpus.queries[199] = corpus.dictionary[0];
+    const SearchServer search_server = MakeTestServer(corpus);
+
+    const vector<vector<Document>> results = ProcessQueries(search_server, corpus.queries);
+    ASSERT_EQUAL(results.size(), corpus.queries.size());
+    for (size_t i = 0; i < corpus.queries.size(); ++i) {
+        AssertSameDocuments(results[i], search_server.FindTopDocuments(corpus.queries[i]), "query "s + to_string(i));
+    }
+    ASSERT(results[3].empty() && results[50].empty() && results[199].empty());
+
+    const JoinedDocuments joined = ProcessQueriesJoined(search_server, corpus.queries);
+    ASSERT_EQUAL(joined.GetQueryCount(), corpus.queries.size());
+    vector<Document> flattened;
+    vector<size_t> expected_offsets = {0};
+    for (const vector<Document>& documents : results) {
+        flattened.insert(flattened.end(), documents.begin(), documents.end());
+        expected_offsets.push_back(flattened.size());
+    }
+    ASSERT_EQUAL(joined.GetOffsets(), expected_offsets);
+    ASSERT_EQUAL(joined.size(), flattened.size());
+    ASSERT_EQUAL(joined.empty(), flattened.empty());
+    AssertSameDocuments(joined.GetDocuments(), flattened, "joined documents"s);
+    AssertSameDocuments(vector<Document>(joined.begin(), joined.end()), flattened, "joined iteration"s);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto query_documents = joined.GetQueryDocuments(i);
+        AssertSameDocuments(vector<Document>(query_documents.begin(), query_documents.end()), results[i], "joined query "s + to_string(i));
+    }
+    bool is_thrown = false;
+    try {
+        joined.GetQueryDocuments(results.size());
+    } catch (const out_of_range&) {
+        is_thrown = true;
+    }
+    ASSERT_HINT(is_thrown, "query index past the end"s);
+
+    size_t next_query_index = 0;
+    ProcessQueriesJoined(search_server, corpus.queries, [&](size_t query_index, const vector<Document>& documents) {
+        ASSERT_EQUAL(query_index, next_query_index);
+        AssertSameDocuments(documents, results[query_index], "consumer query "s + to_string(query_index));
+        ++next_query_index;
+    });
+    ASSERT_EQUAL(next_query_index, corpus.queries.size());
+
+    const JoinedDocuments no_queries = ProcessQueriesJoined(search_server, {});
+    ASSERT_EQUAL(no_queries.GetQueryCount(), 0u);
+    ASSERT(no_queries.empty());
+    ASSERT_EQUAL(no_queries.GetOffsets(), vector<size_t>{0});
+}
+
+//=================================================================================
+void TestMetricsHistogramsAndCounters() {
+    using Histogram = LatencyHistogram;
+    ASSERT_EQUAL(Histogram::GetBucketLowerBound(0), 0u);
+    for (size_t i = 0; i + 1 < Histogram::BUCKET_COUNT; ++i) {
+        const uint64_t lower_bound = Histogram::GetBucketLowerBound(i);
+        const uint64_t upper_bound = Histogram::GetBucketUpperBound(i);
+        const string hint = "bucket "s + to_string(i);
+        ASSERT_HINT(lower_bound <= upper_bound, hint);
+        ASSERT_EQUAL_HINT(Histogram::GetBucketLowerBound(i + 1), upper_bound + 1, hint);
+        ASSERT_EQUAL_HINT(Histogram::GetBucketIndex(lower_bound), i, hint);
+        ASSERT_EQUAL_HINT(Histogram::GetBucketIndex(upper_bound), i, hint);
+        ASSERT_HINT((upper_bound - lower_bound + 1) * Histogram::SUB_BUCKET_COUNT <= max(lower_bound, Histogram::SUB_BUCKET_COUNT), hint);
+    }
+    for (uint64_t value = 0; value < Histogram::SUB_BUCKET_COUNT; ++value) {
+        ASSERT_EQUAL(Histogram::GetBucketIndex(value), value);
+    }
+    // The last bucket is the top sub-bucket of 2^MAX_EXPONENT, open upwards
+    const size_t last_bucket = Histogram::BUCKET_COUNT - 1;
+    const uint64_t max_exponent_power = uint64_t{1} << Histogram::MAX_EXPONENT;
+    ASSERT_EQUAL(Histogram::GetBucketLowerBound(last_bucket), 2 * max_exponent_power - max_exponent_power / Histogram::SUB_BUCKET_COUNT);
+    ASSERT_EQUAL(Histogram::GetBucketUpperBound(last_bucket), numeric_limits<uint64_t>::max());
+    ASSERT_EQUAL(Histogram::GetBucketIndex(Histogram::GetBucketLowerBound(last_bucket) - 1), last_bucket - 1);
+    ASSERT_EQUAL(Histogram::GetBucketIndex(2 * max_exponent_power), last_bucket);
+    ASSERT_EQUAL(Histogram::GetBucketIndex(numeric_limits<uint64_t>::max()), last_bucket);
+
+    // Log-uniform values from 1 ns to about 1 s, compared with exact percentiles of the sorted values
+    mt19937_64 generator(61);
+    uniform_real_distribution<double> exponent(0., 30.);
+    vector<uint64_t> values(20'000);
+    for (uint64_t& value : values) {
+        value = static_cast<uint64_t>(exp2(exponent(generator)));
+    }
+    Histogram histogram;
+    for (const uint64_t value : values) {
+        histogram.Record(value);
+    }
+    const HistogramSnapshot snapshot = histogram.GetSnapshot();
+    sort(values.begin(), values.end());
+    ASSERT_EQUAL(snapshot.count, values.size());
+    ASSERT_EQUAL(snapshot.sum, accumulate(values.begin(), values.end(), uint64_t{0}));
+    ASSERT_EQUAL(snapshot.max, values.back());
+    ASSERT(abs(snapshot.GetMean() - static_cast<double>(snapshot.sum) / values.size()) < 1e-9);
+    for (const double percentile : {0., 1., 25., 50., 90., 99., 99.9, 100.}) {
+        const size_t rank = clamp<size_t>(static_cast<size_t>(ceil(percentile / 100. * values.size())), 1, values.size());
+        const uint64_t exact_value = values[rank - 1];
+        const uint64_t value = snapshot.GetValueAtPercentile(percentile);
+        const string hint = "p"s + to_string(percentile);
+        ASSERT_HINT(value >= exact_value, hint);
+        ASSERT_HINT(value <= min(Histogram::GetBucketUpperBound(Histogram::GetBucketIndex(exact_value)), snapshot.max), hint);
+    }
+    ASSERT_EQUAL(snapshot.GetValueAtPercentile(100.), values.back());
+    ASSERT_EQUAL(HistogramSnapshot().GetValueAtPercentile(50.), 0u);
+
+    // More threads than shards, so some threads share a shard
+    const size_t thread_count = 2 * metrics_detail::SHARD_COUNT;
+    MetricCounter counter;
+    Histogram shared_histogram;
+    vector<thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < values.size(); i += thread_count) {
+                counter.Add(2);
+                shared_histogram.Record(values[i]);
+            }
+        });
+    }
+    for (thread& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQUAL(counter.Get(), 2 * values.size());
+    const HistogramSnapshot merged_snapshot = shared_histogram.GetSnapshot();
+    ASSERT_EQUAL(merged_snapshot.count, snapshot.count);
+    ASSERT_EQUAL(merged_snapshot.sum, snapshot.sum);
+    ASSERT_EQUAL(merged_snapshot.max, snapshot.max);
+    ASSERT_EQUAL(merged_snapshot.bucket_counts, snapshot.bucket_counts);
+
+    counter.Reset();
+    shared_histogram.Reset();
+    ASSERT_EQUAL(counter.Get(), 0u);
+    const HistogramSnapshot reset_snapshot = shared_histogram.GetSnapshot();
+    ASSERT_EQUAL(reset_snapshot.count, 0u);
+    ASSERT_EQUAL(reset_snapshot.sum, 0u);
+    ASSERT_EQUAL(reset_snapshot.max, 0u);
+
+    // A registry gives one metric per name and reports what was recorded
+    MetricsRegistry registry;
+    ASSERT_EQUAL(&registry.GetCounter("requests"sv), &registry.GetCounter("requests"s));
+    ASSERT_EQUAL(&registry.GetHistogram("latency"sv), &registry.GetHistogram("latency"s));
+    registry.GetCounter("requests"sv).Add(3);
+    registry.GetHistogram("latency"sv).Record(100);
+    registry.GetHistogram("latency"sv).Record(300);
+    const MetricsSnapshot metrics = registry.GetSnapshot();
+    ASSERT_EQUAL(metrics.counters.at("requests"s), 3u);
+    ASSERT_EQUAL(metrics.histograms.at("latency"s).count, 2u);
+    ASSERT_EQUAL(metrics.histograms.at("latency"s).sum, 400u);
+    ostringstream text;
+    metrics.PrintText(text);
+    ASSERT_EQUAL(text.str(), "requests 3\nlatency count 2 mean 200 p50 103 p90 300 p99 300 p999 300 max 300\n"s);
+    registry.Reset();
+    ASSERT_EQUAL(registry.GetSnapshot().counters.at("requests"s), 0u);
+}
+
+//=================================================================================
+void TestRemoveDocumentsMatchesRemoveDocument() {
+    const TestCorpus corpus = GenerateTestCorpus(67, 150, 3'000, 15, 40, 4);
+    SearchServer single_server = MakeTestServer(corpus);
+    SearchServer batch_server = MakeTestServer(corpus);
+    SearchServer par_batch_server = MakeTestServer(corpus);
+    vector<size_t> added_posting_counts;
+    for (const string& word : corpus.dictionary) {
+        added_posting_counts.push_back(single_server.GetPostingListStats(word).posting_count);
+    }
+
+    // A tenth of the documents, then a further third: most posting lists pass the threshold on the way
+    vector<int> document_ids(corpus.documents.size());
+    iota(document_ids.begin(), document_ids.end(), 0);
+    shuffle(document_ids.begin(), document_ids.end(), mt19937(71));
+    vector<int> first_removed_ids;
+    vector<int> second_removed_ids;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        (i % 10 == 0 ? first_removed_ids : second_removed_ids).push_back(document_ids[i]);
+    }
+    second_removed_ids.resize(document_ids.size() / 3);
+    second_removed_ids.push_back(second_removed_ids.front());
+    second_removed_ids.push_back(100'000);
+    for (const vector<int>* removed_ids : {&first_removed_ids, &second_removed_ids}) {
+        for (const int document_id : *removed_ids) {
+            single_server.RemoveDocument(document_id);
+        }
+        batch_server.RemoveDocuments(execution::seq, *removed_ids);
+        par_batch_server.RemoveDocuments(execution::par, *removed_ids);
+        const string hint = "removed "s + to_string(removed_ids->size());
+        AssertSameServerState(batch_server, single_server, corpus, hint + " seq"s);
+        AssertSameServerState(par_batch_server, single_server, corpus, hint + " par"s);
+    }
+
+    // Compaction happened for both: most lists hold fewer postings than they got
+    size_t compacted_list_count = 0;
+    for (size_t i = 0; i < corpus.dictionary.size(); ++i) {
+        compacted_list_count += single_server.GetPostingListStats(corpus.dictionary[i]).posting_count < added_posting_counts[i]
+                && batch_server.GetPostingListStats(corpus.dictionary[i]).posting_count < added_posting_counts[i];
+    }
+    ASSERT(compacted_list_count > corpus.dictionary.size() / 2);
+
+    // Everything goes: every list is compacted to nothing
+    for (const int document_id : document_ids) {
+        single_server.RemoveDocument(document_id);
+    }
+    batch_server.RemoveDocuments(document_ids);
+    AssertSameServerState(batch_server, single_server, corpus, "all removed"s);
+    ASSERT_EQUAL(batch_server.GetDocumentCount(), 0);
+    for (const string& word : corpus.dictionary) {
+        ASSERT_EQUAL_HINT(batch_server.GetPostingListStats(word).posting_count, 0u, word);
+        ASSERT_EQUAL_HINT(single_server.GetPostingListStats(word).posting_count, 0u, word);
+    }
+    ASSERT_EQUAL(batch_server.GetPostingListStats("unknownword"sv).posting_count, 0u);
+}
+
+//=================================================================================
+void TestAddDocumentsMatchesAddDocument() {
+    const TestCorpus corpus = GenerateTestCorpus(73, 150, 3'000, 15, 40, 4);
+    vector<RawDocument> documents;
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        documents.push_back(MakeTestDocument(corpus, i, 3));
+    }
+    shuffle(documents.begin(), documents.end(), mt19937(79));
+
+    const auto read_snapshot = [](const SearchServer& search_server) {
+        const string snapshot_path = (filesystem::temp_directory_path() / "search_server_test_batch_snapshot.bin").string();
+        search_server.SaveSnapshot(snapshot_path);
+        ifstream snapshot_file(snapshot_path, ios::binary);
+        const string snapshot((istreambuf_iterator<char>(snapshot_file)), istreambuf_iterator<char>());
+        snapshot_file.close();
+        filesystem::remove(snapshot_path);
+        return snapshot;
+    };
+    const auto assert_same_index = [&](const SearchServer& search_server, const SearchServer& expected_server, const string& hint) {
+        AssertSameServerState(search_server, expected_server, corpus, hint);
+        ASSERT_HINT(read_snapshot(search_server) == read_snapshot(expected_server), hint + ", snapshot"s);
+    };
+
+    // Two batches, the second one into a server that is not empty
+    const size_t first_batch_size = documents.size() / 3;
+    SearchServer single_server(corpus.dictionary[0]);
+    for (const RawDocument& document : documents) {
+        single_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    SearchServer batch_server(corpus.dictionary[0]);
+    batch_server.AddDocuments(vector<RawDocument>(documents.begin(), documents.begin() + first_batch_size));
+    batch_server.AddDocuments(vector<RawDocument>(documents.begin() + first_batch_size, documents.end()));
+    assert_same_index(batch_server, single_server, "added in two batches"s);
+    SearchServer one_batch_server(corpus.dictionary[0]);
+    one_batch_server.AddDocuments(documents);
+    assert_same_index(one_batch_server, single_server, "added in one batch"s);
+
+    // Removed documents come back in a batch
+    vector<RawDocument> removed_documents;
+    for (size_t i = 0; i < documents.size(); i += 4) {
+        removed_documents.push_back(documents[i]);
+        single_server.RemoveDocument(documents[i].id);
+        batch_server.RemoveDocument(documents[i].id);
+    }
+    for (const RawDocument& document : removed_documents) {
+        single_server.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    batch_server.AddDocuments(removed_documents);
+    assert_same_index(batch_server, single_server, "added again"s);
+
+    // A rejected batch adds nothing, also not the documents before the rejected one
+    const vector<RawDocument> rejected_batch = {{1'000'000, corpus.documents[0], DocumentStatus::ACTUAL, {1}}, documents[0]};
+    bool is_thrown = false;
+    try {
+        batch_server.AddDocuments(rejected_batch);
+    } catch (const invalid_argument&) {
+        is_thrown = true;
+    }
+    ASSERT(is_thrown);
+    assert_same_index(batch_server, single_server, "rejected batch"s);
+}
+
+//=================================================================================
+void TestMovedFromArenaAndServerAreReusable() {
+    StringArena arena;
+    const string_view alpha = arena.Store("alpha"sv);
+    StringArena moved_arena(move(arena));
+    const string_view zzzzz = arena.Store("ZZZZZ"sv);
+    const string_view gamma = moved_arena.Store("gamma"sv);
+    ASSERT_EQUAL(alpha, "alpha"sv);
+    ASSERT_EQUAL(zzzzz, "ZZZZZ"sv);
+    ASSERT_EQUAL(gamma, "gamma"sv);
+
+    StringArena assigned_arena;
+    const string_view beta = assigned_arena.Store("beta"sv);
+    assigned_arena = move(moved_arena);
+    const string_view delta = moved_arena.Store("delta"sv);
+    const string_view epsilon = assigned_arena.Store("epsilon"sv);
+    ASSERT_EQUAL(alpha, "alpha"sv);
+    ASSERT_EQUAL(gamma, "gamma"sv);
+    ASSERT_EQUAL(delta, "delta"sv);
+    ASSERT_EQUAL(epsilon, "epsilon"sv);
+    ASSERT_EQUAL(zzzzz, "ZZZZZ"sv);
+    ASSERT_EQUAL(beta.size(), 4u);
+
+    const TestCorpus corpus = GenerateTestCorpus(83, 100, 200, 10, 20, 3);
+    SearchServer search_server = MakeTestServer(corpus);
+    const SearchServer expected_server = MakeTestServer(corpus);
+    SearchServer moved_server(move(search_server));
+
+    // New words in the moved-from server would land in the arena block of the moved server
+    search_server.AddDocument(1, "xxxxxxxx yyyyyyyy zzzzzzzz"sv, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "xxxxxxxx wwwwwwww"sv, DocumentStatus::ACTUAL, {2});
+    moved_server.AddDocument(1'000, "qqqqqqqq"sv, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
+    ASSERT_EQUAL(search_server.FindTopDocuments("xxxxxxxx"sv).size(), 2u);
+    ASSERT_EQUAL(search_server.GetWordFrequencies(1).size(), 3u);
+    ASSERT(search_server.FindTopDocuments(corpus.queries[0]).empty());
+    moved_server.RemoveDocument(1'000);
+    AssertSameServerState(moved_server, expected_server, corpus, "moved server"s);
+
+    // Reassigned from a fresh server
+    search_server = SearchServer(corpus.dictionary[0]);
+    search_server.AddDocument(3, "vvvvvvvv"sv, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 1);
+    AssertSameServerState(moved_server, expected_server, corpus, "moved server after reassignment"s);
+
+    // Moved back by assignment, the words of the source are intact
+    SearchServer assigned_server(corpus.dictionary[0]);
+    assigned_server.AddDocument(4, "uuuuuuuu"sv, DocumentStatus::ACTUAL, {1});
+    assigned_server = move(moved_server);
+    moved_server.AddDocument(5, "tttttttt ssssssss"sv, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(moved_server.GetDocumentCount(), 1);
+    AssertSameServerState(assigned_server, expected_server, corpus, "assigned server"s);
+}
+
+//=================================================================================
+void TestOrdinalCompactionKeepsServerState() {
+    const TestCorpus corpus = GenerateTestCorpus(89, 150, 2'000, 15, 40, 4);
+    const int added_id_base = 10'000;
+    const size_t added_count = 500;
+    vector<int> shuffled_ids(corpus.documents.size());
+    iota(shuffled_ids.begin(), shuffled_ids.end(), 0);
+    shuffle(shuffled_ids.begin(), shuffled_ids.end(), mt19937(97));
+    const int kept_id = shuffled_ids.back();
+
+    // Live documents of the corpus by index, then the added ones in the order they were added
+    const auto make_expected_server = [&](const set<int>& removed_ids, bool has_added_documents) {
+        SearchServer expected_server(corpus.dictionary[0]);
+        for (size_t i = 0; i < corpus.documents.size(); ++i) {
+            const RawDocument document = MakeTestDocument(corpus, i);
+            if (removed_ids.count(document.id) == 0) {
+                expected_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            }
+        }
+        for (size_t i = 0; has_added_documents && i < added_count; ++i) {
+            RawDocument document = MakeTestDocument(corpus, i);
+            document.id += added_id_base;
+            if (removed_ids.count(document.id) == 0) {
+                expected_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            }
+        }
+        return expected_server;
+    };
+
+    for (const bool is_parallel : {false, true}) {
+        const string policy_hint = is_parallel ? "par"s : "seq"s;
+        SearchServer search_server = MakeTestServer(corpus);
+        const map<string_view, double>* kept_word_freqs = &search_server.GetWordFrequencies(kept_id);
+        const map<string_view, double> expected_kept_word_freqs = *kept_word_freqs;
+        const auto remove_documents = [&](const vector<int>& document_ids) {
+            if (is_parallel) {
+                search_server.RemoveDocuments(execution::par, document_ids);
+            } else {
+                search_server.RemoveDocuments(execution::seq, document_ids);
+            }
+        };
+
+        // 40% of the documents stay below the threshold, a further tenth of them passes it in one batch
+        set<int> removed_ids;
+        for (size_t i = 0; i < 800; ++i) {
+            search_server.RemoveDocument(shuffled_ids[i]);
+            removed_ids.insert(shuffled_ids[i]);
+        }
+        AssertSameServerState(search_server, make_expected_server(removed_ids, false), corpus, policy_hint + ", 800 removed"s);
+        const vector<int> crossing_ids(shuffled_ids.begin() + 800, shuffled_ids.begin() + 1'001);
+        remove_documents(crossing_ids);
+        removed_ids.insert(crossing_ids.begin(), crossing_ids.end());
+        for (const string& word : corpus.dictionary) {
+            ASSERT_EQUAL_HINT(search_server.GetPostingListStats(word).removed_posting_count, 0u, policy_hint + ", word "s + word);
+        }
+        ASSERT_HINT(&search_server.GetWordFrequencies(kept_id) == kept_word_freqs, policy_hint);
+        ASSERT_EQUAL_HINT(*kept_word_freqs, expected_kept_word_freqs, policy_hint);
+        AssertSameServerState(search_server, make_expected_server(removed_ids, false), corpus, policy_hint + ", 1001 removed"s);
+
+        // New documents get ordinals after the renumbered ones, and removals go on from there
+        vector<RawDocument> added_documents;
+        for (size_t i = 0; i < added_count; ++i) {
+            added_documents.push_back(MakeTestDocument(corpus, i));
+            added_documents.back().id += added_id_base;
+        }
+        search_server.AddDocuments(added_documents);
+        vector<int> later_removed_ids(shuffled_ids.begin() + 1'001, shuffled_ids.begin() + 1'300);
+        for (size_t i = 0; i < added_count; i += 5) {
+            later_removed_ids.push_back(added_id_base + static_cast<int>(i));
+        }
+        remove_documents(later_removed_ids);
+        removed_ids.insert(later_removed_ids.begin(), later_removed_ids.end());
+        ASSERT_EQUAL_HINT(*kept_word_freqs, expected_kept_word_freqs, policy_hint);
+        AssertSameServerState(search_server, make_expected_server(removed_ids, true), corpus, policy_hint + ", added and removed"s);
+    }
+}
+
+//=================================================================================
+void TestConcurrentMapAddsUpEveryKey() {
+    {
+        ConcurrentMap<int, int64_t> counts(1);
+        ConcurrentMap<int, double> sums(1);
+        const int thread_count = 8;
+        const int add_count = 10'000;
+        vector<thread> threads;
+        for (int i = 0; i < thread_count; ++i) {
+            threads.emplace_back([&counts, &sums]() {
+                for (int j = 0; j < add_count; ++j) {
+                    counts.Add(7, 1);
+                    sums.Add(7, 0.5);
+                }
+            });
+        }
+        for (thread& adding_thread : threads) {
+            adding_thread.join();
+        }
+        ASSERT_EQUAL(counts.size(), 1u);
+        ASSERT_EQUAL(sums.size(), 1u);
+        counts.ForEach([](int key, int64_t count) {
+            ASSERT_EQUAL(key, 7);
+            ASSERT_EQUAL(count, int64_t{thread_count} * add_count);
+        });
+        sums.ForEach([](int key, double sum) {
+            ASSERT_EQUAL(key, 7);
+            ASSERT_EQUAL(sum, thread_count * add_count * 0.5);
+        });
+    }
+
+    // Room for 4 keys is one bucket of 8 slots. Keys homed in the last slot by the Fibonacci hash of the map
+    // take it and then wrap around to the first ones
+    ConcurrentMap<int, int> values(4);
+    const size_t slot_count = 8;
+    const auto get_home_slot = [](int key) {
+        return static_cast<size_t>(static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull >> 16) % slot_count;
+    };
+    map<int, int> expected_values;
+    for (int key = 0; expected_values.size() < 3; ++key) {
+        if (get_home_slot(key) == slot_count - 1) {
+            values.Add(key, key + 1);
+            expected_values[key] += key + 1;
+        }
+    }
+    for (int key = 0; expected_values.size() < slot_count; ++key) {
+        values.Add(key, 1);
+        expected_values[key] += 1;
+    }
+    for (const auto& [key, value] : expected_values) {
+        values.Add(key, 10);
+        expected_values[key] += 10;
+    }
+    map<int, int> found_values;
+    values.ForEach([&found_values](int key, int value) {
+        ASSERT(found_values.emplace(key, value).second);
+    });
+    ASSERT_EQUAL(found_values, expected_values);
+
+    bool is_full = false;
+    try {
+        values.Add(expected_values.rbegin()->first + 1, 1);
+    } catch (const overflow_error&) {
+        is_full = true;
+    }
+    ASSERT(is_full);
+    bool is_reserved = false;
+    try {
+        values.Add(ConcurrentMap<int, int>::EMPTY_KEY, 1);
+    } catch (const invalid_argument&) {
+        is_reserved = true;
+    }
+    ASSERT(is_reserved);
+    ASSERT_EQUAL(values.size(), slot_count);
+}
+
+//=================================================================================
+void TestSearchServer() {
+    RUN_TEST(TestMaxScoreMatchesExhaustiveSearch);
+    RUN_TEST(TestSnapshotRoundTrip);
+    RUN_TEST(TestBatchQueryExecutorMatchesSequentialSearch);
+    RUN_TEST(TestDocumentIdsAreIteratedInIncreasingOrder);
+    RUN_TEST(TestPostingListRoundTrip);
+    RUN_TEST(TestDocumentBitmapMatchesSet);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestRequestQueueWindowRollsOver);
+    RUN_TEST(TestShardedAddDocumentsRejectsInvalidStatus);
+    RUN_TEST(TestShardedSearchMatchesSingleServer);
+    RUN_TEST(TestSplitIntoWordsMatchesScalarSplit);
+    RUN_TEST(TestQueryResultCache);
+    RUN_TEST(TestSearchFilterMatchesPredicate);
+    RUN_TEST(TestMatchDocumentMatchesBaseline);
+    RUN_TEST(TestRemoveDuplicatesKeepsLowestId);
+    RUN_TEST(TestProcessQueriesJoinedMatchesProcessQueries);
+    RUN_TEST(TestMetricsHistogramsAndCounters);
+    RUN_TEST(TestRemoveDocumentsMatchesRemoveDocument);
+    RUN_TEST(TestAddDocumentsMatchesAddDocument);
+    RUN_TEST(TestMovedFromArenaAndServerAreReusable);
+    RUN_TEST(TestOrdinalCompactionKeepsServerState);
+    RUN_TEST(TestConcurrentMapAddsUpEveryKey);
+}
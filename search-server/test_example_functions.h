@@ -1,10 +1,15 @@
-//#pragma once
+#pragma once
 
-////=================================================================================
-//// Описание сервера
-//#include "search_server.h"
-//// Hand-made фреймворк для юнит-тестов
-//#include "asserts.h"
+//=================================================================================
+// Описание сервера
+#include "search_server.h"
+// Hand-made фреймворк для юнит-тестов
+#include "asserts.h"
+
+//=================================================================================
+#include <random>
+#include <string>
+#include <vector>
 
 ////=================================================================================
 ////Добавление документов. Добавленный документ должен находиться по поисковому запросу, который содержит слова из документа.
@@ -50,3 +55,146 @@
 ////=================================================================================
 //// Тест проверяет количество документов на сервере
 //void TestDocumentsCount();
+
+//=================================================================================
+// Random corpus of the tests: documents and queries drawn from one dictionary, the same seed gives the same corpus
+struct TestCorpus {
+    std::vector<std::string> dictionary;
+    std::vector<std::string> documents;
+    std::vector<std::string> queries;
+};
+
+TestCorpus GenerateTestCorpus(unsigned seed, int dictionary_size, int document_count, int document_word_count,
+                              int query_count, int query_word_count, double minus_prob = 0.2);
+
+// The document index of the corpus with id index * id_step, status index % 4 and rating index % 7
+RawDocument MakeTestDocument(const TestCorpus& corpus, size_t index, int id_step = 1);
+
+// Server with the first word of the dictionary as a stop word and every document of the corpus added by AddDocument
+SearchServer MakeTestServer(const TestCorpus& corpus);
+
+// Same ids, ratings and relevances up to rounding, in the same order
+void AssertSameDocuments(const std::vector<Document>& documents, const std::vector<Document>& expected_documents, const std::string& hint);
+
+// No posting list of a corpus word keeps SearchServer::MAX_REMOVED_POSTINGS_SHARE of removed postings
+void AssertPostingListsCompacted(const SearchServer& search_server, const TestCorpus& corpus, const std::string& hint);
+
+// Same documents, word frequencies, results of the corpus queries under every status, duplicates and live postings
+// of every corpus word; both servers keep their posting lists compacted
+void AssertSameServerState(const SearchServer& search_server, const SearchServer& expected_server, const TestCorpus& corpus, const std::string& hint);
+
+//=================================================================================
+// Top documents found with MaxScore are those of scoring every posting, for statuses, predicates and result sizes
+void TestMaxScoreMatchesExhaustiveSearch();
+
+//=================================================================================
+// A loaded snapshot answers like the server it was saved from; a file with a wrong magic, version, checksum
+// or size is rejected and leaves the server as it was
+void TestSnapshotRoundTrip();
+
+//=================================================================================
+// Batches give the results of sequential searches, with long queries split into ranges, results streamed
+// in the order of the queries, batches of concurrent callers and a batch started from a consumer
+void TestBatchQueryExecutorMatchesSequentialSearch();
+
+//=================================================================================
+// Documents are iterated and indexed by increasing id, whatever the order they were added and removed in
+void TestDocumentIdsAreIteratedInIncreasingOrder();
+
+//=================================================================================
+// Bit-packed posting blocks decode to what was appended around the block size, for widths of 0 bits to 32 bits,
+// after compaction and after a snapshot round trip
+void TestPostingListRoundTrip();
+
+//=================================================================================
+// Status bitmaps, unions of minus word postings and the filter built of them give the same sets as std::set,
+// across chunk boundaries and while chunks switch between sorted arrays and bitsets
+void TestDocumentBitmapMatchesSet();
+
+//=================================================================================
+// Word frequencies are those of the document without stop words, the same map is returned until the document is removed
+void TestWordFrequencies();
+
+//=================================================================================
+// Requests leave the window bucket by bucket as the ring rolls over, also after a pause longer than the window,
+// and requests of concurrent threads are all counted. The window is 4 buckets of 100 ms on a fake clock
+void TestRequestQueueWindowRollsOver();
+
+//=================================================================================
+// A document the sharded server would reject is rejected before the batch is split between the shards
+void TestShardedAddDocumentsRejectsInvalidStatus();
+
+//=================================================================================
+// A sharded server finds the same documents with the same relevance as one SearchServer of the same documents,
+// under every policy, and still does after removals past the compaction threshold of the shards;
+// sequential relevance is the same bit for bit
+void TestShardedSearchMatchesSingleServer();
+
+//=================================================================================
+// Every supported instruction set splits text into the same words as a plain byte loop and finds the same control characters:
+// words crossing 16- and 32-byte block edges, runs of spaces, leading and trailing spaces, control characters and bytes from 0x80
+void TestSplitIntoWordsMatchesScalarSplit();
+
+//=================================================================================
+// The result cache hits on a repeated and on an equivalent query, misses once the index changes, evicts the least
+// recently used entry of a full shard, holds exactly its capacity however small and counts all of it; cached results
+// are those of a server without the cache
+void TestQueryResultCache();
+
+//=================================================================================
+// A SearchFilter finds the same documents as the predicate lambda of the same conditions, under every policy and
+// with a search context, also after removals; a status out of DocumentStatus is rejected
+void TestSearchFilterMatchesPredicate();
+
+//=================================================================================
+// MatchDocument and MatchDocuments keep the semantics of the matching by words they replaced: the sorted distinct plus words
+// of the document, nothing if it has a minus word, stop words ignored on both sides, and an error for a missing document
+void TestMatchDocumentMatchesBaseline();
+
+//=================================================================================
+// RemoveDuplicates removes every document with the same set of words, stop words aside, as one with a smaller id,
+// whatever the order the documents were added in, keeps the lowest id of each set and reports the removed ids
+// from the largest one as the word-set comparison it replaced did
+void TestRemoveDuplicatesKeepsLowestId();
+
+//=================================================================================
+// ProcessQueriesJoined holds the results of ProcessQueries flattened in the order of the queries, with offsets
+// delimiting every query, queries without results included; the consumer sees the queries one by one in order
+void TestProcessQueriesJoinedMatchesProcessQueries();
+
+//=================================================================================
+// Histogram buckets tile the values without gaps, hold every value in the bucket its bounds give and keep the
+// relative error under 1 / SUB_BUCKET_COUNT; percentiles bound the exact ones from above within a bucket; counters and
+// histograms updated from more threads than there are shards merge to the totals of one thread
+void TestMetricsHistogramsAndCounters();
+
+//=================================================================================
+// RemoveDocuments, sequential and parallel, leaves a server that answers as one after a loop of RemoveDocument,
+// across the compaction threshold of the posting lists and with unknown and repeated ids; the posting lists may
+// differ by the postings of removed documents, neither keeps MAX_REMOVED_POSTINGS_SHARE of them
+void TestRemoveDocumentsMatchesRemoveDocument();
+
+//=================================================================================
+// AddDocuments leaves the index a loop of AddDocument builds: batches with ids out of
+// order, into an empty and a filled server and after removals save the same snapshot; a rejected batch adds nothing
+void TestAddDocumentsMatchesAddDocument();
+
+//=================================================================================
+// A moved-from arena or server is empty and may be used again without touching what was moved out of it:
+// the stored strings and interned terms of the new owner stay as they were
+void TestMovedFromArenaAndServerAreReusable();
+
+//=================================================================================
+// Once half of the ordinals belong to removed documents, sequential and parallel removals renumber the rest:
+// no posting of a removed document is left, the server answers as one built of the live documents, the word
+// frequency maps stay in place, and documents added and removed afterwards are indexed as usual
+void TestOrdinalCompactionKeepsServerState();
+
+//=================================================================================
+// ConcurrentMap sums the values added to one key from many threads, probes past the last slot to the first one,
+// fills every slot and then rejects a new key while still adding to the keys it holds
+void TestConcurrentMapAddsUpEveryKey();
+
+//=================================================================================
+// Runs the tests above
+void TestSearchServer();
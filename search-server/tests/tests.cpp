@@ -0,0 +1,9 @@
+// Unit tests of the search server.
+// Built from the search-server directory, with every source except main.cpp:
+//   g++ -std=c++17 -O2 -I. tests/tests.cpp $(ls *.cpp | grep -v main.cpp) -ltbb -lpthread -o search_server_tests
+
+#include "test_example_functions.h"
+
+int main() {
+    TestSearchServer();
+}
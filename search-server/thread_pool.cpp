@@ -0,0 +1,149 @@
+#include "thread_pool.h"
+
+//=================================================================================
+#include <algorithm>
+#include <utility>
+
+//=================================================================================
+WorkStealingThreadPool::Batch::Batch(std::function<void (size_t, size_t)> task) : task_(std::move(task))
+{
+}
+
+//=================================================================================
+WorkStealingThreadPool::WorkStealingThreadPool(size_t thread_count)
+{
+    thread_count = std::max<size_t>(thread_count, 1);
+    queues_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i){
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i){
+        threads_.emplace_back([this, i]{ RunWorker(i); });
+    }
+}
+
+//=================================================================================
+WorkStealingThreadPool::~WorkStealingThreadPool()
+{
+    {
+        std::lock_guard guard(work_mutex_);
+        is_stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& thread : threads_){
+        thread.join();
+    }
+}
+
+//=================================================================================
+size_t WorkStealingThreadPool::GetThreadCount() const
+{
+    return threads_.size();
+}
+
+//=================================================================================
+void WorkStealingThreadPool::Start(Batch &batch, size_t task_count)
+{
+    batch.remaining_task_count_ = task_count;
+    batch.is_done_ = task_count == 0;
+    batch.exception_ = nullptr;
+    if (task_count == 0){
+        return;
+    }
+
+    {
+        // Counted under the lock, so that a worker going to sleep either sees the tasks or gets the notification
+        std::lock_guard guard(work_mutex_);
+        queued_task_count_ += task_count;
+    }
+    const size_t worker_count = queues_.size();
+    for (size_t worker = 0; worker < worker_count; ++worker){
+        std::lock_guard queue_guard(queues_[worker]->mutex);
+        for (size_t i = worker; i < task_count; i += worker_count){
+            queues_[worker]->tasks.push_back({&batch, i});
+        }
+    }
+    work_available_.notify_all();
+}
+
+//=================================================================================
+void WorkStealingThreadPool::Wait(Batch &batch)
+{
+    std::unique_lock lock(batch.mutex_);
+    batch.done_.wait(lock, [&batch]{ return batch.is_done_; });
+    if (batch.exception_){
+        std::rethrow_exception(std::exchange(batch.exception_, nullptr));
+    }
+}
+
+//=================================================================================
+void WorkStealingThreadPool::Run(size_t task_count, const std::function<void (size_t, size_t)> &task)
+{
+    Batch batch(task);
+    Start(batch, task_count);
+    Wait(batch);
+}
+
+//=================================================================================
+void WorkStealingThreadPool::RunWorker(size_t worker_index)
+{
+    while (true){
+        QueuedTask task{};
+        while (TakeTask(worker_index, task)){
+            RunTask(task, worker_index);
+        }
+
+        std::unique_lock lock(work_mutex_);
+        work_available_.wait(lock, [this]{ return is_stopping_ || queued_task_count_ != 0; });
+        if (is_stopping_){
+            return;
+        }
+    }
+}
+
+//=================================================================================
+bool WorkStealingThreadPool::TakeTask(size_t worker_index, QueuedTask &task)
+{
+    {
+        WorkerQueue& own = *queues_[worker_index];
+        std::lock_guard guard(own.mutex);
+        if (!own.tasks.empty()){
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            --queued_task_count_;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i){
+        WorkerQueue& victim = *queues_[(worker_index + i) % queues_.size()];
+        std::lock_guard guard(victim.mutex);
+        if (!victim.tasks.empty()){
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            --queued_task_count_;
+            return true;
+        }
+    }
+    return false;
+}
+
+//=================================================================================
+void WorkStealingThreadPool::RunTask(const QueuedTask &task, size_t worker_index)
+{
+    Batch& batch = *task.batch;
+    try {
+        batch.task_(task.task_index, worker_index);
+    } catch (...) {
+        std::lock_guard guard(batch.mutex_);
+        if (!batch.exception_){
+            batch.exception_ = std::current_exception();
+        }
+    }
+    if (batch.remaining_task_count_.fetch_sub(1) == 1){
+        // The waiter may destroy the batch as soon as the lock is released
+        std::lock_guard guard(batch.mutex_);
+        batch.is_done_ = true;
+        batch.done_.notify_all();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+//=================================================================================
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//=================================================================================
+// Persistent pool of worker threads with a deque of tasks each. A batch is dealt out round-robin;
+// a worker takes its own tasks from the back (the last indexes first) and, once out of them, steals from
+// the front of the others, so a batch finishes when its total work is done.
+// Batches of concurrent callers share the workers, their tasks are queued side by side.
+// A task must not wait for another batch of the same pool: it would hold up a worker the other batch may need
+class WorkStealingThreadPool {
+public:
+    // Tasks of one call of Start, the caller keeps it until Wait returns
+    class Batch {
+    public:
+        explicit Batch(std::function<void(size_t task_index, size_t worker_index)> task);
+
+    private:
+        friend class WorkStealingThreadPool;
+
+        const std::function<void(size_t, size_t)> task_;
+        std::atomic<size_t> remaining_task_count_ = 0;
+        std::mutex mutex_;
+        std::condition_variable done_;
+        bool is_done_ = false;
+        std::exception_ptr exception_;
+    };
+
+    explicit WorkStealingThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+    ~WorkStealingThreadPool();
+
+    WorkStealingThreadPool(const WorkStealingThreadPool&) = delete;
+    WorkStealingThreadPool& operator=(const WorkStealingThreadPool&) = delete;
+
+    size_t GetThreadCount() const;
+
+    // Queues the calls of batch's task(task_index, worker_index) for every task index in [0, task_count)
+    // and returns at once
+    void Start(Batch& batch, size_t task_count);
+    // Blocks until every task of the batch is done, then rethrows the first exception thrown by them
+    void Wait(Batch& batch);
+    // Start and Wait
+    void Run(size_t task_count, const std::function<void(size_t task_index, size_t worker_index)>& task);
+
+private:
+    struct QueuedTask {
+        Batch* batch;
+        size_t task_index;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<QueuedTask> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex work_mutex_;
+    std::condition_variable work_available_;
+    std::atomic<size_t> queued_task_count_ = 0;
+    bool is_stopping_ = false;
+
+    void RunWorker(size_t worker_index);
+    bool TakeTask(size_t worker_index, QueuedTask& task);
+    void RunTask(const QueuedTask& task, size_t worker_index);
+};
@@ -0,0 +1,76 @@
+#include "top_documents.h"
+
+//=================================================================================
+#include <algorithm>
+#include <cmath>
+
+//=================================================================================
+namespace {
+constexpr double DOUBLE_CALCULATION_ERROR = 1e-6;
+}
+
+//=================================================================================
+bool IsMoreRelevant(const Document &lhs, const Document &rhs)
+{
+    if (std::abs(lhs.relevance - rhs.relevance) < DOUBLE_CALCULATION_ERROR) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        // Fully tied documents are ordered by id, so the result does not depend on the evaluation order
+        return lhs.id < rhs.id;
+    } else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
+
+//=================================================================================
+TopDocuments::TopDocuments(size_t max_count) : max_count_(max_count)
+{
+    heap_.reserve(max_count_);
+}
+
+//=================================================================================
+void TopDocuments::Reset(size_t max_count)
+{
+    max_count_ = max_count;
+    heap_.clear();
+    heap_.reserve(max_count_);
+}
+
+//=================================================================================
+void TopDocuments::Add(const Document &document)
+{
+    if (heap_.size() < max_count_){
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())){
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+//=================================================================================
+bool TopDocuments::MayAccept(double max_relevance) const
+{
+    if (heap_.size() < max_count_){
+        return true;
+    }
+    // Documents closer than the calculation error are compared by rating, so leave a margin for them
+    return max_count_ > 0 && max_relevance > heap_.front().relevance - 2 * DOUBLE_CALCULATION_ERROR;
+}
+
+//=================================================================================
+std::vector<Document> TopDocuments::Extract()
+{
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return std::move(heap_);
+}
+
+//=================================================================================
+void TopDocuments::ExtractTo(std::vector<Document> &documents)
+{
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    documents.assign(heap_.begin(), heap_.end());
+    heap_.clear();
+}
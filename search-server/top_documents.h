@@ -0,0 +1,36 @@
+#pragma once
+
+//=================================================================================
+#include <vector>
+
+//=================================================================================
+#include "document.h"
+
+//=================================================================================
+// Ordering of search results: higher relevance first, higher rating for equal relevance, then lower id.
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+//=================================================================================
+// Keeps the best max_count documents seen so far in a bounded heap,
+// so selecting top-K out of n matches costs O(n log K) and O(K) memory.
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count);
+
+    // Empties the heap for a new selection, keeping its capacity
+    void Reset(size_t max_count);
+
+    void Add(const Document& document);
+
+    // False only if no document with relevance up to max_relevance can get into the heap anymore
+    bool MayAccept(double max_relevance) const;
+
+    // Returns the collected documents ordered by IsMoreRelevant
+    std::vector<Document> Extract();
+    // Same, but copies them into documents and keeps the heap storage for reuse
+    void ExtractTo(std::vector<Document>& documents);
+
+private:
+    size_t max_count_;
+    std::vector<Document> heap_;    // the least relevant of the kept documents is on top
+};